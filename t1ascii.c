@@ -163,16 +163,25 @@ pfa_output_ascii(char *data, int len)
 static void
 pfa_output_binary(unsigned char *data, int len)
 {
-  static const char *hexchar = "0123456789abcdef";
-  for (; len > 0; len--, data++) {
+  char buf[2048];
+  while (len > 0) {
+    int n;
     /* trim hexadecimal lines to line_length columns */
     if (hexcol >= line_length) {
       putc('\n', ofp);
       hexcol = 0;
     }
-    putc(hexchar[(*data >> 4) & 0xf], ofp);
-    putc(hexchar[*data & 0xf], ofp);
-    hexcol += 2;
+    /* encode as many bytes as fit on this line */
+    n = (line_length - hexcol + 1) / 2;
+    if (n > len)
+      n = len;
+    if (n > (int) sizeof(buf) / 2)
+      n = sizeof(buf) / 2;
+    hex_encode(buf, data, n);
+    fwrite(buf, 1, 2 * n, ofp);
+    hexcol += 2 * n;
+    data += n;
+    len -= n;
   }
 }
 
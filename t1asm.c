@@ -66,9 +66,11 @@
 #include <errno.h>
 #include <lcdf/clp.h>
 #include "t1lib.h"
-#include "t1asmhelp.h"
-
-#define LINESIZE 512
+#include "t1scan.h"
+#include "t1cs.h"
+#include "t1records.h"
+#include "t1fontinfo.h"
+#include "t1subrs.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -87,91 +89,47 @@ static int active = 0;
 static int ever_active = 0;
 static int start_charstring = 0;
 static int in_eexec = 0;
-
-/* need to add 1 as space for \0 */
-static char line[LINESIZE + 1];
-
-/* for charstring buffering */
-static byte *charstring_buf, *charstring_bp;
-static int charstring_bufsiz;
-
-/* decryption stuff */
-static uint16_t er, cr;
+static int binary_input = 0;
+
+/* The current input line or charstring token is line[0..line_len-1]. It
+   is not null-terminated. Where possible, `line' points straight into the
+   input buffer; a line that spans more than one buffer is collected in
+   line_buf, which grows as needed. Lines have no length limit. */
+static char *line;
+static int line_len;
+static char *line_buf;
+static int line_cap;
+
+/* tracks lenIV, the charstring start command, and where Subrs, CharStrings
+   and `currentfile closefile' appear */
+static struct t1scan scan;
+
+/* for charstring buffering: charstrings are collected in plaintext and
+   encrypted in batches by encrypt_charstrings(); eexec output that follows
+   a pending charstring is held in pending_text until the batch is done */
+#define PENDING_BATCH 256
+
+static struct pending_charstring {
+  int text_pos;                 /* charstring goes here in pending_text */
+  int data_pos;                 /* plaintext starts here in pending_data */
+  int len;
+  int encrypt;
+  int cache;                    /* cache entry for the result, or -1 */
+} pending[PENDING_BATCH];
+static int npending = 0;
+static char *pending_text;
+static int pending_text_len, pending_text_cap;
+static byte *pending_data;
+static int pending_data_len, pending_data_cap;
+static int charstring_pos;      /* start of current charstring */
+
+/* encryption stuff */
+static uint16_t er;
 static const uint32_t c1 = 52845;
 static const uint32_t c2 = 22719;
 
-/* table of charstring commands */
-static struct command {
-  const char *name;
-  int one, two;
-} command_table[] = {
-  { "abs", 12, 9 },             /* Type 2 */
-  { "add", 12, 10 },            /* Type 2 */
-  { "and", 12, 3 },             /* Type 2 */
-  { "blend", 16, -1 },          /* Type 2 */
-  { "callgsubr", 29, -1 },      /* Type 2 */
-  { "callother", 12, 16 },      /* Type 1 ONLY */
-  { "callothersubr", 12, 16 },  /* Type 1 ONLY */
-  { "callsubr", 10, -1 },
-  { "closepath", 9, -1 },       /* Type 1 ONLY */
-  { "cntrmask", 20, -1 },       /* Type 2 */
-  { "div", 12, 12 },
-  { "dotsection", 12, 0 },      /* Type 1 ONLY */
-  { "drop", 12, 18 },           /* Type 2 */
-  { "dup", 12, 27 },            /* Type 2 */
-  { "endchar", 14, -1 },
-  { "eq", 12, 15 },             /* Type 2 */
-  { "error", 0, -1 },           /* special */
-  { "escape", 12, -1 },         /* special */
-  { "exch", 12, 28 },           /* Type 2 */
-  { "flex", 12, 35 },           /* Type 2 */
-  { "flex1", 12, 37 },          /* Type 2 */
-  { "get", 12, 21 },            /* Type 2 */
-  { "hflex", 12, 34 },          /* Type 2 */
-  { "hflex1", 12, 36 },         /* Type 2 */
-  { "hhcurveto", 27, -1 },      /* Type 2 */
-  { "hintmask", 19, -1 },       /* Type 2 */
-  { "hlineto", 6, -1 },
-  { "hmoveto", 22, -1 },
-  { "hsbw", 13, -1 },           /* Type 1 ONLY */
-  { "hstem", 1, -1 },
-  { "hstem3", 12, 2 },          /* Type 1 ONLY */
-  { "hstemhm", 18, -1 },        /* Type 2 */
-  { "hvcurveto", 31, -1 },
-  { "ifelse", 12, 22 },         /* Type 2 */
-  { "index", 12, 29 },          /* Type 2 */
-  { "load", 12, 13 },           /* Type 2 */
-  { "mul", 12, 24 },            /* Type 2 */
-  { "neg", 12, 14 },            /* Type 2 */
-  { "not", 12, 5 },             /* Type 2 */
-  { "or", 12, 4 },              /* Type 2 */
-  { "pop", 12, 17 },            /* Type 1 ONLY */
-  { "put", 12, 20 },            /* Type 2 */
-  { "random", 12, 23 },         /* Type 2 */
-  { "rcurveline", 24, -1 },     /* Type 2 */
-  { "return", 11, -1 },
-  { "rlinecurve", 25, -1 },     /* Type 2 */
-  { "rlineto", 5, -1 },
-  { "rmoveto", 21, -1 },
-  { "roll", 12, 30 },           /* Type 2 */
-  { "rrcurveto", 8, -1 },
-  { "sbw", 12, 7 },             /* Type 1 ONLY */
-  { "seac", 12, 6 },            /* Type 1 ONLY */
-  { "setcurrentpoint", 12, 33 }, /* Type 1 ONLY */
-  { "sqrt", 12, 26 },           /* Type 2 */
-  { "store", 12, 8 },           /* Type 2 */
-  { "sub", 12, 11 },            /* Type 2 */
-  { "vhcurveto", 30, -1 },
-  { "vlineto", 7, -1 },
-  { "vmoveto", 4, -1 },
-  { "vstem", 3, -1 },
-  { "vstem3", 12, 1 },          /* Type 1 ONLY */
-  { "vstemhm", 23, -1 },        /* Type 2 */
-  { "vvcurveto", 26, -1 },      /* Type 2 */
-};                                                /* alphabetical */
-
-/* Two separate encryption functions because eexec and charstring encryption
-   must proceed in parallel. */
+/* Charstring encryption is done in batches (see flush_pending), so this
+   only handles eexec encryption. */
 
 static byte eencrypt(byte plain)
 {
@@ -182,19 +140,6 @@ static byte eencrypt(byte plain)
   return cipher;
 }
 
-static byte cencrypt(byte plain)
-{
-  byte cipher;
-
-  /* Thanks to Tom Kacvinsky <tjk@ams.org> who reported that lenIV == -1 means
-     unencrypted charstrings. */
-  if (lenIV < 0) return plain;
-
-  cipher = (byte)(plain ^ (cr >> 8));
-  cr = (uint16_t)((cipher + cr) * c1 + c2);
-  return cipher;
-}
-
 /* This function outputs a single byte.  If output is in PFB format then output
    is buffered through blockbuf[].  If output is in PFA format, then output
    will be hexadecimal if in_eexec is set, ASCII otherwise. */
@@ -234,34 +179,418 @@ static void eexec_byte(byte b)
     output_byte(b);
 }
 
-/* This function outputs a null-terminated string through possible eexec
-   encryption. */
+/* This function grows a pending buffer to hold at least `need' bytes. */
+
+static void *grow_buffer(void *buf, int *cap, int need)
+{
+  if (need > *cap) {
+    int new_cap = (*cap ? *cap : 65536);
+    while (need > new_cap)
+      new_cap *= 2;
+    if (!(buf = realloc(buf, new_cap)))
+      fatal_error("out of memory");
+    *cap = new_cap;
+  }
+  return buf;
+}
+
+/* This function returns the signed big-endian integer at `p'. */
+
+static int32_t get_int(const byte *p, int nbytes)
+{
+  uint32_t val = (p[0] & 0x80 ? ~0U : 0U);
+  while (nbytes-- > 0)
+    val = (val << 8) | *p++;
+  return (int32_t) val;
+}
+
+
+/* The charstring cache (--cache) maps a charstring's source, as text or as
+   a binary record, to its encrypted bytes. A cached charstring is copied
+   to the output without being parsed, encoded or encrypted; only the eexec
+   pass runs over it. Sources are identified by two independent 32-bit
+   hashes plus their length. The key includes lenIV, since that changes
+   the bytes. The cache file holds the charstrings of the latest run. */
+
+#define CACHE_MAGIC	"T1AC\0\0\0\5"
+#define CACHE_MAGIC_LEN	8
+#define CACHE_HEADER_LEN 21	/* kind, lenIV, hashes, lengths */
+
+#define CACHE_TEXT	0	/* source is charstring text */
+#define CACHE_RECORD	1	/* source is a binary charstring record */
+#define CACHE_OPTIMIZED	2	/* added to kind with --optimize */
+#define CACHE_STRIPPED	4	/* added to kind with --strip-hints */
+#define CACHE_GLYPH	8	/* added for glyphs when the passes above
+				   treat them differently from Subrs */
+
+struct cache_key {
+  uint32_t hash1;
+  uint32_t hash2;
+  int kind;
+  int lenIV;
+  int src_len;
+};
+
+struct cache_entry {
+  struct cache_key key;
+  int data_pos;                 /* encrypted bytes start here in cache_data */
+  int data_len;                 /* -1 until the charstring is encrypted */
+  int used;
+};
+
+static const char *cache_file = 0;
+static struct cache_entry *cache;
+static int ncache = 0, cache_cap = 0;
+static int *cache_table;        /* entry index + 1, or 0 if empty */
+static int cache_table_size = 0, cache_table_cap = 0;
+static byte *cache_data;
+static int cache_data_len = 0, cache_data_cap = 0;
+static int cache_changed = 0;
+
+static void cache_make_key(struct cache_key *key, int kind, int lenIV,
+                           const byte *src, int len)
+{
+  /* FNV-1a, and a multiply-xorshift hash */
+  uint32_t h1 = 2166136261U, h2 = 0x9E3779B9U;
+  key->kind = kind;
+  key->lenIV = lenIV;
+  key->src_len = len;
+  for (; len > 0; src++, len--) {
+    h1 = (h1 ^ *src) * 16777619U;
+    h2 = (h2 ^ *src) * 0x5BD1E995U;
+    h2 ^= h2 >> 15;
+  }
+  key->hash1 = h1;
+  key->hash2 = h2;
+}
+
+#define cache_key_equal(a, b) \
+  ((a)->hash1 == (b)->hash1 && (a)->hash2 == (b)->hash2 \
+   && (a)->kind == (b)->kind && (a)->lenIV == (b)->lenIV \
+   && (a)->src_len == (b)->src_len)
+
+/* This function returns the index of the entry for a key, or -1. */
+
+static int cache_find(const struct cache_key *key)
+{
+  int i, j;
+  if (!cache_table_size)
+    return -1;
+  for (i = key->hash1 & (cache_table_size - 1); (j = cache_table[i]);
+       i = (i + 1) & (cache_table_size - 1))
+    if (cache_key_equal(&cache[j - 1].key, key))
+      return j - 1;
+  return -1;
+}
+
+/* This function adds an entry, without encrypted bytes, and returns its
+   index. */
+
+static int cache_add(const struct cache_key *key)
+{
+  int i;
+
+  if (2 * (ncache + 1) > cache_table_size) {
+    cache_table_size = (cache_table_size ? 2 * cache_table_size : 1024);
+    cache_table = (int *) grow_buffer(cache_table, &cache_table_cap,
+                                      cache_table_size * sizeof(int));
+    memset(cache_table, 0, cache_table_size * sizeof(int));
+    for (i = 0; i < ncache; i++) {
+      int j = cache[i].key.hash1 & (cache_table_size - 1);
+      while (cache_table[j])
+        j = (j + 1) & (cache_table_size - 1);
+      cache_table[j] = i + 1;
+    }
+  }
+
+  cache = (struct cache_entry *) grow_buffer(cache, &cache_cap,
+                                             (ncache + 1) * sizeof(*cache));
+  cache[ncache].key = *key;
+  cache[ncache].data_pos = cache[ncache].data_len = -1;
+  cache[ncache].used = 1;
+
+  for (i = key->hash1 & (cache_table_size - 1); cache_table[i];
+       i = (i + 1) & (cache_table_size - 1))
+    /* nada */;
+  cache_table[i] = ncache + 1;
+  return ncache++;
+}
+
+/* This function stores an entry's encrypted bytes. */
 
-static void eexec_string(const char *string)
+static void cache_set_data(int i, const byte *data, int len)
 {
-  while (*string)
-    eexec_byte(*string++);
+  if (cache[i].data_len < 0) {
+    cache_data = (byte *) grow_buffer(cache_data, &cache_data_cap,
+                                      cache_data_len + len);
+    memcpy(cache_data + cache_data_len, data, len);
+    cache[i].data_pos = cache_data_len;
+    cache[i].data_len = len;
+    cache_data_len += len;
+    cache_changed = 1;
+  }
+}
+
+/* This function reads the cache file, if it exists. A damaged cache file
+   is ignored. */
+
+static void cache_load(void)
+{
+  FILE *f = fopen(cache_file, "rb");
+  byte header[CACHE_HEADER_LEN];
+  size_t n;
+
+  if (!f)
+    return;
+
+  n = fread(header, 1, CACHE_MAGIC_LEN, f);
+  if (n != CACHE_MAGIC_LEN || memcmp(header, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0)
+    goto bad;
+
+  while ((n = fread(header, 1, CACHE_HEADER_LEN, f)) == CACHE_HEADER_LEN) {
+    struct cache_key key;
+    int i, len = get_int(header + 17, 4);
+    key.kind = header[0];
+    key.lenIV = get_int(header + 1, 4);
+    key.src_len = get_int(header + 5, 4);
+    key.hash1 = (uint32_t) get_int(header + 9, 4);
+    key.hash2 = (uint32_t) get_int(header + 13, 4);
+    if (len < 0 || cache_data_len > INT_MAX / 4 - len)
+      goto bad;
+    cache_data = (byte *) grow_buffer(cache_data, &cache_data_cap,
+                                      cache_data_len + len);
+    if (fread(cache_data + cache_data_len, 1, len, f) != (size_t) len)
+      goto bad;
+    i = cache_add(&key);
+    cache[i].data_pos = cache_data_len;
+    cache[i].data_len = len;
+    cache[i].used = 0;
+    cache_data_len += len;
+  }
+  if (n != 0 || ferror(f))
+    goto bad;
+  fclose(f);
+  return;
+
+ bad:
+  error("warning: %s: bad cache file ignored", cache_file);
+  ncache = cache_data_len = 0;
+  if (cache_table_size)
+    memset(cache_table, 0, cache_table_size * sizeof(int));
+  fclose(f);
 }
 
+static void cache_put_int(FILE *f, int32_t val, int nbytes)
+{
+  while (--nbytes >= 0)
+    putc((int) ((uint32_t) val >> (8 * nbytes)) & 0xFF, f);
+}
+
+/* This function writes the entries used in this run to the cache file. It
+   writes a temporary file first, so an interrupted run can't leave a
+   damaged cache behind. */
+
+static void cache_save(void)
+{
+  char *tmp;
+  FILE *f;
+  int i;
+
+  /* leave the file alone if it already holds exactly these charstrings */
+  for (i = 0; i < ncache && !cache_changed; i++)
+    if (!cache[i].used && cache[i].data_len >= 0)
+      cache_changed = 1;
+  if (!cache_changed)
+    return;
+
+  if (!(tmp = (char *) malloc(strlen(cache_file) + 5)))
+    fatal_error("out of memory");
+  sprintf(tmp, "%s.tmp", cache_file);
+  if (!(f = fopen(tmp, "wb"))) {
+    error("warning: %s: %s", tmp, strerror(errno));
+    free(tmp);
+    return;
+  }
+
+  fwrite(CACHE_MAGIC, 1, CACHE_MAGIC_LEN, f);
+  for (i = 0; i < ncache; i++) {
+    struct cache_entry *e = &cache[i];
+    if (e->used && e->data_len >= 0) {
+      putc(e->key.kind, f);
+      cache_put_int(f, e->key.lenIV, 4);
+      cache_put_int(f, e->key.src_len, 4);
+      cache_put_int(f, (int32_t) e->key.hash1, 4);
+      cache_put_int(f, (int32_t) e->key.hash2, 4);
+      cache_put_int(f, e->data_len, 4);
+      fwrite(cache_data + e->data_pos, 1, e->data_len, f);
+    }
+  }
+
+  if (ferror(f) | fclose(f)) {
+    error("warning: %s: %s", tmp, strerror(errno));
+    remove(tmp);
+  } else if (rename(tmp, cache_file) != 0) {
+    error("warning: %s: %s", cache_file, strerror(errno));
+    remove(tmp);
+  }
+  free(tmp);
+}
+
+/* This function encrypts the pending charstrings as one batch, then outputs
+   them and the text between them through possible eexec encryption. */
+
+static void flush_pending(void)
+{
+  byte *cs[PENDING_BATCH];
+  int cs_len[PENDING_BATCH];
+  int i, j, n = 0, text_pos = 0;
+
+  for (i = 0; i < npending; i++)
+    if (pending[i].encrypt) {
+      cs[n] = pending_data + pending[i].data_pos;
+      cs_len[n] = pending[i].len;
+      n++;
+    }
+  encrypt_charstrings(cs, cs_len, n);
+
+  for (i = 0; i < npending; i++)
+    if (pending[i].cache >= 0)
+      cache_set_data(pending[i].cache, pending_data + pending[i].data_pos,
+                     pending[i].len);
+
+  for (i = 0; i < npending; i++) {
+    for (j = text_pos; j < pending[i].text_pos; j++)
+      eexec_byte(pending_text[j]);
+    for (j = 0; j < pending[i].len; j++)
+      eexec_byte(pending_data[pending[i].data_pos + j]);
+    text_pos = pending[i].text_pos;
+  }
+  for (j = text_pos; j < pending_text_len; j++)
+    eexec_byte(pending_text[j]);
+
+  npending = pending_text_len = pending_data_len = 0;
+}
+
+/* With --subroutinize, --flatten-subrs, or --compact-subrs, the eexec
+   section is collected before any of it is output, since the passes need
+   every charstring. The section becomes a list of pieces, text or
+   charstrings, which font_output replays through the usual output path
+   once the passes have run. */
+
+#define PIECE_TEXT      0
+#define PIECE_SUBR      1       /* index is the Subr number */
+#define PIECE_GLYPH     2       /* index is in font.glyphs */
+#define PIECE_OTHER     3       /* neither; the piece owns `cs' */
+#define PIECE_NONE      4       /* a dropped Subr */
+
+struct font_piece {
+  int kind;
+  int index;
+  int text_pos;                 /* PIECE_TEXT: text is in font_text */
+  int text_len;
+  char *name;                   /* PIECE_GLYPH: glyph name */
+  struct t1cs_ir *cs;           /* PIECE_OTHER */
+  int lenIV;
+  int number_pos;               /* PIECE_TEXT: replace the Subr number here */
+  int number_len;               /* (0 if none) */
+  int number;                   /* with this one */
+};
+
+static int subroutinize = 0;
+static int flatten_subrs = 0;
+static int compact_subrs = 0;
+static int collecting = 0;
+static struct t1cs_font font;
+static struct font_piece *pieces;
+static int npieces = 0, pieces_cap = 0;
+static int glyphs_cap = 0;
+static char *font_text;
+static int font_text_len = 0, font_text_cap = 0;
+static int subrs_count_pos = -1;  /* `N' in `/Subrs N' is in font_text here */
+static int subrs_count_len;
+static int subrs_count;           /* written there */
+
+/* This function returns the first option given that needs the font
+   collected, or null. */
+
+static const char *collecting_options(void)
+{
+  if (subroutinize)
+    return "--subroutinize";
+  else if (flatten_subrs)
+    return "--flatten-subrs";
+  else if (compact_subrs)
+    return "--compact-subrs";
+  else
+    return 0;
+}
+
+static struct font_piece *add_piece(int kind)
+{
+  struct font_piece *fp;
+  pieces = (struct font_piece *) grow_buffer(pieces, &pieces_cap,
+                                             (npieces + 1) * sizeof(*fp));
+  fp = &pieces[npieces++];
+  memset(fp, 0, sizeof(*fp));
+  fp->kind = kind;
+  fp->number_pos = -1;
+  return fp;
+}
+
+static void collect_text(const char *text, int len)
+{
+  if (len == 0)
+    return;
+  if (!npieces || pieces[npieces - 1].kind != PIECE_TEXT)
+    add_piece(PIECE_TEXT)->text_pos = font_text_len;
+  font_text = (char *) grow_buffer(font_text, &font_text_cap,
+                                   font_text_len + len);
+  memcpy(font_text + font_text_len, text, len);
+  font_text_len += len;
+  pieces[npieces - 1].text_len += len;
+}
+
+/* This function outputs `len' bytes of text through possible eexec
+   encryption. The text is held back if charstrings are pending, and
+   collected if the whole font is. */
+
+static void eexec_text(const char *text, int len)
+{
+  if (collecting)
+    collect_text(text, len);
+  else if (npending) {
+    pending_text = (char *) grow_buffer(pending_text, &pending_text_cap,
+                                        pending_text_len + len);
+    memcpy(pending_text + pending_text_len, text, len);
+    pending_text_len += len;
+  } else
+    for (; len > 0; len--)
+      eexec_byte(*text++);
+}
+
+#define eexec_string(s)		eexec_text((s), strlen(s))
+
 /* This function gets ready for the eexec-encrypted data.  If output is in
    PFB format then flush current ASCII block and get ready for binary block.
    We start encryption with four random (zero) bytes. */
 
-static void eexec_start(char *string)
+static void eexec_start(const char *text, int len)
 {
   eexec_string("currentfile eexec\n");
+  flush_pending();
   if (pfb && w.blocktyp != PFB_BINARY) {
     pfb_writer_output_block(&w);
     w.blocktyp = PFB_BINARY;
   }
 
   in_eexec = 1;
+  collecting = (collecting_options() != 0);
   er = 55665;
   eexec_byte(0);
   eexec_byte(0);
   eexec_byte(0);
   eexec_byte(0);
-  eexec_string(string);
+  eexec_text(text, len);
 }
 
 /* 25.Aug.1999 -- Return 1 if this line actually looks like the start of a
@@ -270,31 +599,235 @@ static void eexec_start(char *string)
 
 static int check_line_charstring(void)
 {
-  char *p = line;
-  while (isspace((unsigned char) *p))
+  const char *p = line, *end = line + line_len;
+  while (p < end && isspace((unsigned char) *p))
     p++;
-  return (*p == '/' || (p[0] == 'd' && p[1] == 'u' && p[2] == 'p'));
+  return (p < end
+          && (*p == '/' || (end - p >= 3 && memcmp(p, "dup", 3) == 0)));
 }
 
-/* This function returns an input line of characters. A line is terminated by
-   length (including terminating null) greater than LINESIZE, \r, \n, \r\n, or
-   when active (looking for charstrings) by '{'. When terminated by a newline
-   the newline is put into line[]. When terminated by '{', the '{' is not put
-   into line[], and the flag start_charstring is set to 1. */
+/* Input is read in large chunks into inbuf, and scanned with pointers.
+   in_eof is set, like feof(), once reading finds no more input. Text is
+   never read with stdio one character at a time. */
+
+#define INBUF_SIZE 65536
+
+static byte inbuf[INBUF_SIZE];
+static byte *in_pos = inbuf;
+static byte *in_end = inbuf;
+static int in_eof = 0;
+
+/* This function refills inbuf. It returns 0 at the end of the input. */
+
+static int fill_input(void)
+{
+  int n = fread(inbuf, 1, INBUF_SIZE, ifp);
+  in_pos = inbuf;
+  in_end = inbuf + n;
+  if (n == 0)
+    in_eof = 1;
+  return n != 0;
+}
+
+/* returns the next input character, or EOF */
+#define input_getc() \
+  (in_pos < in_end || fill_input() ? *in_pos++ : EOF)
+
+/* This function reads up to `len' bytes and returns how many it read. */
+
+static int input_read(void *buf, int len)
+{
+  byte *p = (byte *) buf;
+  while (len > 0 && (in_pos < in_end || fill_input())) {
+    int n = in_end - in_pos;
+    if (n > len)
+      n = len;
+    memcpy(p, in_pos, n);
+    in_pos += n;
+    p += n;
+    len -= n;
+  }
+  return p - (byte *) buf;
+}
+
+
+/* This function starts an empty line. */
+
+static void line_clear(void)
+{
+  line = line_buf;
+  line_len = 0;
+}
+
+/* This function moves the current line into line_buf, so it survives the
+   input buffer (or binary record) being refilled. */
+
+static void line_save(void)
+{
+  if (line != line_buf) {
+    line_buf = (char *) grow_buffer(line_buf, &line_cap, line_len);
+    memcpy(line_buf, line, line_len);
+    line = line_buf;
+  }
+}
+
+/* This function appends `len' bytes at `s' to the current line. Bytes
+   that directly follow the line in memory are added without copying. */
+
+static void line_add(byte *s, int len)
+{
+  if (line_len == 0)
+    line = (char *) s;
+  else if (line != line_buf && line + line_len == (char *) s)
+    /* nada */;
+  else {
+    line_save();
+    line_buf = line = (char *) grow_buffer(line_buf, &line_cap,
+                                           line_len + len);
+    memcpy(line + line_len, s, len);
+  }
+  line_len += len;
+}
+
+
+/* Binary input, from `t1disasm --format=binary', is a series of records
+   described in t1records.h. Text records are split into lines as if they
+   had been read from a text file. A charstring record ends the current
+   line, as a `{' would. */
+
+static byte *record;
+static int record_cap = 0;
+static int record_type = 0;
+static int record_len = 0;
+static int record_pos = 0;
+static int binary_done = 0;
+
+/* This function reads the next record, or sets binary_done at the end. */
+
+static void read_record(void)
+{
+  byte header[T1R_HEADER_LEN];
+
+  record_pos = 0;
+  if (input_read(header, T1R_HEADER_LEN) != T1R_HEADER_LEN) {
+    error("warning: binary input ends without end record");
+    record_type = T1R_END;
+  } else if ((record_len = get_int(header + 1, 4)) < 0)
+    fatal_error("bad binary input record length");
+  else {
+    record_type = header[0];
+    record = (byte *) grow_buffer(record, &record_cap, record_len);
+    if (input_read(record, record_len) != record_len)
+      fatal_error("binary input ends in the middle of a record");
+  }
+
+  if (record_type == T1R_END)
+    binary_done = 1, record_len = 0;
+  else if (record_type != T1R_TEXT && record_type != T1R_CHARSTRING)
+    fatal_error("unknown binary input record type %d", record_type);
+}
+
+/* This function returns a line of text from binary input; see
+   t1utils_getline. */
+
+static void binary_getline(void)
+{
+  static byte space[] = " ";
+  start_charstring = 0;
+
+  while (1) {
+    byte *q, *end;
+
+    if (record_type != T1R_TEXT || record_pos == record_len) {
+      if (binary_done)
+        break;
+      line_save();
+      read_record();
+      if (record_type == T1R_CHARSTRING) {
+        /* t1disasm prints ` {' after the charstring's key */
+        line_add(space, 1);
+        start_charstring = 1;
+        break;
+      }
+      continue;
+    }
+
+    q = record + record_pos;
+    end = record + record_len;
+    while (q < end && *q != '\n' && *q != '\r')
+      q++;
+    if (q < end)
+      q++;
+    line_add(record + record_pos, q - (record + record_pos));
+    record_pos = q - record;
+    if (q[-1] == '\r') {
+      if (record_pos < record_len && record[record_pos] == '\n')
+        record_pos++;
+      line[line_len - 1] = '\n';
+      break;
+    } else if (q[-1] == '\n')
+      break;
+  }
+}
+
+/* This function returns 1, and skips the magic number, if the input file
+   is in the binary format. */
+
+static int check_binary_input(void)
+{
+  if (fill_input() && in_end - in_pos >= T1R_MAGIC_LEN
+      && memcmp(in_pos, T1R_MAGIC, T1R_MAGIC_LEN) == 0) {
+    in_pos += T1R_MAGIC_LEN;
+    return 1;
+  }
+  return 0;
+}
+
+static int input_done(void)
+{
+  if (binary_input)
+    return binary_done;
+  else
+    return in_eof || ferror(ifp);
+}
+
+/* This function returns an input line of characters. A line is terminated
+   by \r, \n, \r\n, or when active (looking for charstrings) by '{'. When
+   terminated by a newline the newline is put into line[]. When terminated by
+   '{', the '{' is not put into line[], and the flag start_charstring is set
+   to 1. */
 
 static void t1utils_getline(void)
 {
   int c;
-  char *p = line;
   int comment = 0;
   start_charstring = 0;
+  line_clear();
 
-  while (p < line + LINESIZE) {
-    c = getc(ifp);
+  if (binary_input) {
+    binary_getline();
+    return;
+  }
 
-    if (c == EOF)
-      break;
-    else if (c == '%')
+  while (1) {
+    byte *q;
+
+    if (in_pos == in_end) {
+      line_save();
+      if (!fill_input())
+        break;
+    }
+
+    for (q = in_pos; q < in_end && *q != '\n' && *q != '\r' && *q != '%'
+           && *q != '{'; q++)
+      /* nada */;
+    line_add(in_pos, q - in_pos);
+    in_pos = q;
+    if (q == in_end)
+      continue;
+
+    c = *in_pos++;
+    if (c == '%')
       comment = 1;
     else if (active && !comment && c == '{') {
       /* 25.Aug.1999 -- new check for whether we should stop be active */
@@ -305,20 +838,21 @@ static void t1utils_getline(void)
         active = 0;
     }
 
-    *p++ = (char) c;
+    line_add(q, 1);
 
     /* end of line processing: change CR or CRLF into LF, and exit */
     if (c == '\r') {
-      c = getc(ifp);
-      if (c != '\n')
-        ungetc(c, ifp);
-      p[-1] = '\n';
+      line[line_len - 1] = '\n';
+      if (in_pos == in_end) {
+        line_save();
+        fill_input();
+      }
+      if (in_pos < in_end && *in_pos == '\n')
+        in_pos++;
       break;
     } else if (c == '\n')
       break;
   }
-
-  *p = '\0';
 }
 
 /* This function wraps-up the eexec-encrypted data and writes ASCII trailer.
@@ -329,6 +863,7 @@ static void eexec_end(void)
 {
   int i, j;
 
+  flush_pending();
   if (!pfb)
     putc('\n', ofp);
   else if (w.blocktyp != PFB_ASCII) {
@@ -345,199 +880,984 @@ static void eexec_end(void)
   }
 }
 
-/* This function is used by the binary search, bsearch(), for command names in
-   the command table. */
+/* This function buffers a single byte of plaintext charstring data. */
 
-static int CDECL command_compare(const void *key, const void *item)
+static void charstring_byte(int v)
 {
-  return strcmp((const char *) key, ((const struct command *) item)->name);
+  if (pending_data_len == pending_data_cap)
+    pending_data = (byte *) grow_buffer(pending_data, &pending_data_cap,
+                                        pending_data_len + 1);
+  pending_data[pending_data_len++] = (byte)(v & 0xff);
 }
 
-/* This function returns 1 if the string is an integer and 0 otherwise. */
+/* Charstrings are parsed into `ir', then encoded by t1cs_encode_charstring.
+   The arena grows as needed. */
+
+static struct t1cs_ir ir;
+static void *ir_arena = 0;
+static int ir_arena_len = 0;
 
-static int is_integer(char *string)
+/* This function makes room for `n' more operators and `n' more operands. */
+
+static void ir_reserve(int n)
 {
-  if (isdigit((unsigned char) string[0]) || string[0] == '-' || string[0] == '+') {
-    while (*++string && isdigit((unsigned char) *string))
-      ;                                           /* deliberately empty */
-    if (!*string)
-      return 1;
+  struct t1cs_ir old = ir;
+  void *old_arena = ir_arena;
+  int cap = 0;
+
+  if (ir_arena && ir.nops + n <= ir_arena_len && ir.nargs + n <= ir_arena_len)
+    return;
+
+  if (!ir_arena_len)
+    ir_arena_len = 1024;
+  while (ir.nops + n > ir_arena_len || ir.nargs + n > ir_arena_len)
+    ir_arena_len *= 2;
+  ir_arena = grow_buffer(0, &cap, (int) T1CS_ARENA_SIZE(ir_arena_len));
+  t1cs_ir_init(&ir, ir_arena, ir_arena_len);
+  if (old_arena) {
+    memcpy(ir.args, old.args, old.nargs * sizeof(int32_t));
+    memcpy(ir.argstart, old.argstart, (old.nops + 1) * sizeof(int));
+    memcpy(ir.ops, old.ops, old.nops * sizeof(unsigned short));
+    ir.nops = old.nops;
+    ir.nargs = old.nargs;
+    free(old_arena);
   }
-  return 0;
 }
 
-/* This function initializes charstring encryption.  Note that this is called
-   at the beginning of every charstring. */
+/* With --reuse-from, charstrings are looked up in an original font by
+   Subr index or glyph name. An entry whose decoded charstring, and lenIV,
+   match the one just assembled is output with the original's encrypted
+   bytes, so unchanged charstrings stay bit-identical to the original.
+   Original charstrings are compared after decoding and re-encoding, so
+   an original that encodes numbers unusually still matches. */
+
+struct reuse_entry {
+  int subr;                     /* Subr index, or -1 for a glyph */
+  const char *name;             /* glyph name, or "" */
+  int lenIV;
+  const byte *data;             /* as in the original font */
+  int len;
+  byte *plain;                  /* re-encoded, or null if unusable */
+  int plain_len;
+};
+
+static struct reuse_entry *reuse;
+static int nreuse = 0;
+
+/* the current charstring's Subr index, or -1, and glyph name, or "" */
+static int charstring_subr = -1;
+static char *charstring_name;
+static int charstring_name_cap = 0;
+
+static int CDECL reuse_compare(const void *a, const void *b)
+{
+  const struct reuse_entry *ra = (const struct reuse_entry *) a;
+  const struct reuse_entry *rb = (const struct reuse_entry *) b;
+  if (ra->subr != rb->subr)
+    return (ra->subr < rb->subr ? -1 : 1);
+  return strcmp(ra->name, rb->name);
+}
+
+/* This function reads the original font's charstrings. */
+
+static void reuse_load(const char *filename)
+{
+  FILE *f;
+  struct font_charstring *fcs;
+  struct t1cs_ir oir;
+  void *arena = 0;
+  byte **plain;
+  int *plain_len;
+  int i, n, arena_cap = 0;
+
+  if (!(f = fopen(filename, "rb")))
+    fatal_error("%s: %s", filename, strerror(errno));
+  nreuse = read_font_charstrings(f, filename, &fcs);
+  fclose(f);
+  if (!nreuse) {
+    error("warning: %s: no charstrings found", filename);
+    return;
+  }
+
+  reuse = (struct reuse_entry *) malloc(nreuse * sizeof(*reuse));
+  plain = (byte **) malloc(nreuse * sizeof(byte *));
+  plain_len = (int *) malloc(nreuse * sizeof(int));
+  if (!reuse || !plain || !plain_len)
+    fatal_error("out of memory");
+
+  /* decrypt copies of the encrypted charstrings in one batch */
+  for (i = n = 0; i < nreuse; i++) {
+    reuse[i].subr = fcs[i].subr;
+    reuse[i].name = (fcs[i].name ? fcs[i].name : "");
+    reuse[i].lenIV = fcs[i].lenIV;
+    reuse[i].data = fcs[i].data;
+    reuse[i].len = fcs[i].len;
+    if (!(reuse[i].plain = (byte *) malloc(fcs[i].len + 1)))
+      fatal_error("out of memory");
+    memcpy(reuse[i].plain, fcs[i].data, fcs[i].len);
+    if (fcs[i].lenIV >= 0) {
+      plain[n] = reuse[i].plain;
+      plain_len[n] = fcs[i].len;
+      n++;
+    }
+  }
+  decrypt_charstrings(plain, plain_len, n);
+  free(plain);
+  free(plain_len);
+
+  /* re-encode each without its lenIV bytes */
+  for (i = 0; i < nreuse; i++) {
+    struct reuse_entry *r = &reuse[i];
+    int skip = (r->lenIV > 0 ? r->lenIV : 0), len = r->len - skip;
+    byte *p;
+    if (len < 0) {
+      free(r->plain);
+      r->plain = 0;
+      continue;
+    }
+    arena = grow_buffer(arena, &arena_cap, (int) T1CS_ARENA_SIZE(len));
+    t1cs_ir_init(&oir, arena, len);
+    t1cs_decode_charstring(&oir, r->plain + skip, len);
+    if (oir.truncated
+        || !(p = (byte *) malloc(T1CS_ENCODED_SIZE(&oir) + 1))) {
+      free(r->plain);
+      r->plain = 0;
+      continue;
+    }
+    r->plain_len = t1cs_encode_charstring(&oir, p);
+    free(r->plain);
+    r->plain = p;
+  }
+  free(arena);
+  /* the entries now own fcs's names and data */
+  free(fcs);
+
+  qsort(reuse, nreuse, sizeof(*reuse), reuse_compare);
+}
+
+static void set_charstring_name(const char *name, int len)
+{
+  charstring_name = (char *) grow_buffer(charstring_name,
+                                         &charstring_name_cap, len + 1);
+  memcpy(charstring_name, name, len);
+  charstring_name[len] = 0;
+}
+
+/* This function records the Subr index or glyph name of the charstring
+   about to be parsed, from the text before its `{'. */
+
+static void charstring_key(const char *s, int len)
+{
+  const char *end = s + len, *name;
+
+  charstring_subr = -1;
+  set_charstring_name("", 0);
+
+  while (s < end && isspace((unsigned char) *s))
+    s++;
+  if (s < end && *s == '/') {
+    for (name = ++s; s < end && !isspace((unsigned char) *s); s++)
+      /* nada */;
+    set_charstring_name(name, s - name);
+  } else if (end - s >= 3 && memcmp(s, "dup", 3) == 0) {
+    for (s += 3; s < end && isspace((unsigned char) *s); s++)
+      /* nada */;
+    if (s < end && isdigit((unsigned char) *s))
+      for (charstring_subr = 0; s < end && isdigit((unsigned char) *s)
+             && charstring_subr < INT_MAX / 10; s++)
+        charstring_subr = 10 * charstring_subr + *s - '0';
+  }
+}
+
+/* This function replaces the charstring just encoded, which starts at
+   charstring_pos, with the original font's bytes if they match. It returns
+   1 if it did. */
+
+static int charstring_reuse(void)
+{
+  struct reuse_entry key, *r;
+  int skip = (scan.lenIV > 0 ? scan.lenIV : 0);
+
+  key.subr = charstring_subr;
+  key.name = charstring_name;
+  if ((key.subr < 0 && !key.name[0])
+      || !(r = (struct reuse_entry *) bsearch(&key, reuse, nreuse,
+                                              sizeof(*reuse), reuse_compare))
+      || !r->plain || r->lenIV != scan.lenIV
+      || r->plain_len != pending_data_len - charstring_pos - skip
+      || memcmp(r->plain, pending_data + charstring_pos + skip,
+                r->plain_len) != 0)
+    return 0;
+
+  pending_data_len = charstring_pos;
+  pending_data = (byte *) grow_buffer(pending_data, &pending_data_cap,
+                                      pending_data_len + r->len);
+  memcpy(pending_data + pending_data_len, r->data, r->len);
+  pending_data_len += r->len;
+  return 1;
+}
+
+/* This function starts a new charstring with lenIV zero bytes. Note that
+   this is called at the beginning of every charstring. */
 
 static void charstring_start(void)
 {
   int i;
 
-  if (!charstring_buf) {
-    charstring_bufsiz = 65536;
-    if (!(charstring_buf = (byte *) malloc(charstring_bufsiz)))
-      fatal_error("out of memory");
+  charstring_pos = pending_data_len;
+  for (i = 0; i < scan.lenIV; i++)
+    charstring_byte(0);
+  ir_reserve(1);
+  t1cs_ir_clear(&ir);
+}
+
+/* This function queues the charstring bytes starting at charstring_pos,
+   after outputting their length and the charstring start command. If
+   `cache_index' is not -1, the bytes are stored in that cache entry once
+   they are encrypted. */
+
+static void charstring_queue(int encrypt, int cache_index)
+{
+  struct pending_charstring *pcs = &pending[npending];
+  char buf[16];
+  int len = pending_data_len - charstring_pos;
+
+  sprintf(buf, "%d ", len);
+  eexec_string(buf);
+  eexec_string(scan.cs_start);
+  eexec_string(" ");
+
+  pcs->text_pos = pending_text_len;
+  pcs->data_pos = charstring_pos;
+  pcs->len = len;
+  pcs->encrypt = encrypt;
+  pcs->cache = cache_index;
+  if (++npending == PENDING_BATCH)
+    flush_pending();
+}
+
+/* With --optimize, each charstring goes through t1cs_optimize before it is
+   encoded. Subrs may be called with operands already on the stack. */
+
+static int optimize = 0;
+
+/* With --strip-hints, charstrings other than Subrs 0-3 go through
+   t1cs_strip_hints, and strip_hint_entry tidies the Private dictionary.
+   hint_subrs[n] is set once Subr n is seen to be a hint replacement Subr;
+   Subrs come before the glyphs that call them. hint_subrs_hash changes
+   with each one, and keys glyphs in the cache, since they strip
+   differently. Subrs are never cached, so each is seen. */
+
+static int strip_hints = 0;
+static unsigned char *hint_subrs;
+static int nhint_subrs = 0, hint_subrs_cap = 0;
+static uint32_t hint_subrs_hash = 0;
+
+static void add_hint_subr(int n)
+{
+  if (n >= nhint_subrs) {
+    hint_subrs = (unsigned char *) grow_buffer(hint_subrs, &hint_subrs_cap,
+                                               n + 1);
+    memset(hint_subrs + nhint_subrs, 0, n + 1 - nhint_subrs);
+    nhint_subrs = n + 1;
   }
+  if (!hint_subrs[n]) {
+    hint_subrs[n] = 1;
+    hint_subrs_hash = (hint_subrs_hash ^ (uint32_t) n) * 16777619U + 1;
+  }
+}
+
+/* This function returns 1 if the charstring about to be parsed may come
+   from the cache. */
 
-  charstring_bp = charstring_buf;
-  cr = 4330;
-  for (i = 0; i < lenIV; i++)
-    *charstring_bp++ = cencrypt((byte) 0);
+static int charstring_cacheable(void)
+{
+  return cache_file && !(strip_hints && charstring_subr >= 0);
 }
 
-/* This function encrypts and buffers a single byte of charstring data. */
+/* This function adds the parsed charstring to the collected font. A Subr
+   defined twice is left out of the passes after its first definition. */
 
-static void charstring_byte(int v)
+static void collect_charstring(void)
 {
-  byte b = (byte)(v & 0xff);
-  if (charstring_bp - charstring_buf == charstring_bufsiz) {
-    charstring_bufsiz *= 2;
-    if (!(charstring_buf = (byte *) realloc(charstring_buf, charstring_bufsiz)))
+  struct font_piece *fp;
+  int n = charstring_subr;
+
+  if (n >= 0 && n < 65536 && (n >= font.nsubrs || !font.subrs[n])) {
+    if (n >= font.subrs_cap) {
+      int cap = font.subrs_cap * sizeof(struct t1cs_ir *);
+      font.subrs = (struct t1cs_ir **)
+        grow_buffer(font.subrs, &cap, (n + 1) * sizeof(struct t1cs_ir *));
+      font.subrs_cap = cap / sizeof(struct t1cs_ir *);
+    }
+    for (; font.nsubrs <= n; font.nsubrs++)
+      font.subrs[font.nsubrs] = 0;
+    font.subrs[n] = t1cs_ir_copy(&ir);
+    fp = add_piece(PIECE_SUBR);
+    fp->index = n;
+  } else if (n < 0 && charstring_name[0]) {
+    font.glyphs = (struct t1cs_ir **)
+      grow_buffer(font.glyphs, &glyphs_cap,
+                  (font.nglyphs + 1) * sizeof(struct t1cs_ir *));
+    font.glyphs[font.nglyphs] = t1cs_ir_copy(&ir);
+    fp = add_piece(PIECE_GLYPH);
+    fp->index = font.nglyphs++;
+    if (!(fp->name = (char *) malloc(strlen(charstring_name) + 1)))
       fatal_error("out of memory");
-    charstring_bp = charstring_buf + charstring_bufsiz / 2;
+    strcpy(fp->name, charstring_name);
+  } else {
+    fp = add_piece(PIECE_OTHER);
+    fp->cs = t1cs_ir_copy(&ir);
   }
-  *charstring_bp++ = cencrypt(b);
+  fp->lenIV = scan.lenIV;
+  /* drop charstring_start's lenIV bytes */
+  pending_data_len = charstring_pos;
 }
 
-/* This function outputs buffered, encrypted charstring data through possible
-   eexec encryption. */
+static void charstring_output(int cache_index);
+
+/* This function encodes the parsed charstring and queues it for
+   encryption, unless the whole font is being collected. */
 
-static void charstring_end(void)
+static void charstring_end(int cache_index)
 {
-  byte *bp;
+  if (strip_hints && charstring_subr >= 0 && charstring_subr < 65536
+      && t1cs_is_hint_subr(&ir))
+    add_hint_subr(charstring_subr);
+  if (strip_hints && (charstring_subr < 0 || charstring_subr > 3))
+    t1cs_strip_hints(&ir, charstring_subr < 0 && charstring_name[0],
+                     hint_subrs, nhint_subrs);
+  if (optimize)
+    t1cs_optimize(&ir, charstring_subr < 0 && charstring_name[0]);
+  if (collecting)
+    collect_charstring();
+  else
+    charstring_output(cache_index);
+}
+
+/* This function encodes `ir' and queues it for encryption. */
 
-  sprintf(line, "%d ", (int) (charstring_bp - charstring_buf));
-  eexec_string(line);
-  sprintf(line, "%s ", cs_start);
-  eexec_string(line);
-  for (bp = charstring_buf; bp < charstring_bp; bp++)
-    eexec_byte(*bp);
+static void charstring_output(int cache_index)
+{
+  pending_data = (byte *) grow_buffer(pending_data, &pending_data_cap,
+                                      pending_data_len
+                                      + T1CS_ENCODED_SIZE(&ir));
+  pending_data_len += t1cs_encode_charstring(&ir, pending_data
+                                             + pending_data_len);
+  if (nreuse && charstring_reuse())
+    charstring_queue(0, cache_index);
+  else
+    /* Thanks to Tom Kacvinsky <tjk@ams.org> who reported that lenIV == -1
+       means unencrypted charstrings. */
+    charstring_queue(scan.lenIV >= 0, cache_index);
 }
 
-/* This function generates the charstring representation of an integer. */
+/* This function looks up a charstring's source in the cache. If the
+   encrypted bytes are there, it queues them and returns -1. Otherwise it
+   returns the entry to fill in. */
 
-static void charstring_int(int num)
+static int charstring_cached(int kind, const byte *src, int len)
 {
-  int x;
+  struct cache_key key;
+  int i;
 
-  if (num >= -107 && num <= 107) {
-    charstring_byte(num + 139);
-  } else if (num >= 108 && num <= 1131) {
-    x = num - 108;
-    charstring_byte(x / 256 + 247);
-    charstring_byte(x % 256);
-  } else if (num >= -1131 && num <= -108) {
-    x = abs(num) - 108;
-    charstring_byte(x / 256 + 251);
-    charstring_byte(x % 256);
-  } else if (num >= (-2147483647-1) && num <= 2147483647) {
-    charstring_byte(255);
-    charstring_byte(num >> 24);
-    charstring_byte(num >> 16);
-    charstring_byte(num >> 8);
-    charstring_byte(num);
-  } else {
-    error("can't format huge number `%d'", num);
-    /* output 0 instead */
-    charstring_byte(139);
+  if (optimize)
+    kind += CACHE_OPTIMIZED;
+  if (strip_hints)
+    kind += CACHE_STRIPPED;
+  /* a glyph's stack starts empty, so it may optimize or strip
+     differently */
+  if ((optimize || strip_hints) && charstring_subr < 0 && charstring_name[0])
+    kind += CACHE_GLYPH;
+  cache_make_key(&key, kind, scan.lenIV, src, len);
+  if (strip_hints) {
+    key.hash1 ^= hint_subrs_hash;
+    key.hash2 += hint_subrs_hash;
   }
+  if ((i = cache_find(&key)) < 0)
+    return cache_add(&key);
+  cache[i].used = 1;
+  if (cache[i].data_len < 0)
+    return i;
+
+  charstring_pos = pending_data_len;
+  pending_data = (byte *) grow_buffer(pending_data, &pending_data_cap,
+                                      pending_data_len + cache[i].data_len);
+  memcpy(pending_data + pending_data_len, cache_data + cache[i].data_pos,
+         cache[i].data_len);
+  pending_data_len += cache[i].data_len;
+  charstring_queue(0, -1);
+  return -1;
 }
 
-/* This function returns one charstring token. It ignores comments. */
+static const char * const hint_keys[] = {
+  "BlueValues", "OtherBlues", "FamilyBlues", "FamilyOtherBlues",
+  "BlueScale", "BlueShift", "BlueFuzz", "StdHW", "StdVW", "StemSnapH",
+  "StemSnapV", "ForceBold", "LanguageGroup", "ExpansionFactor", 0
+};
+
+/* With --strip-hints, this function removes a Private line that only
+   defines a hinting entry, like `/StdHW [32] def'. /BlueValues, which every
+   font must have, becomes an empty array instead. */
 
-static void get_charstring_token(void)
+static void strip_hint_entry(void)
 {
-  int c = getc(ifp);
-  while (isspace(c))
-    c = getc(ifp);
+  char *p = line, *end = line + line_len, *key, *def;
+  int i;
+
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+  if (p == end || *p != '/')
+    return;
+  for (key = ++p; p < end && isalnum((unsigned char) *p); p++)
+    /* nada */;
+  for (i = 0; hint_keys[i]; i++)
+    if (strlen(hint_keys[i]) == (size_t) (p - key)
+        && memcmp(key, hint_keys[i], p - key) == 0)
+      break;
+  if (!hint_keys[i] || p == end || (!isspace((unsigned char) *p) && *p != '['))
+    return;
+
+  /* the value must be numbers, names or an array of them, and the line
+     must end with the definition */
+  for (def = p; def < end; def++)
+    if (strchr("{}()<>/%", *def))
+      return;
+  while (end > p && isspace((unsigned char) end[-1]))
+    end--;
+  for (def = end; def > p && !isspace((unsigned char) def[-1])
+         && def[-1] != ']'; def--)
+    /* nada */;
+  if (!(end - def == 3 && memcmp(def, "def", 3) == 0)
+      && !(end - def == 2 && (memcmp(def, "ND", 2) == 0
+                              || memcmp(def, "|-", 2) == 0)))
+    return;
+
+  if (i > 0)
+    line_len = 0;
+  else if (def - p >= 4) {
+    memcpy(p, " [] ", 4);
+    memmove(p + 4, def, line + line_len - def);
+    line_len -= def - (p + 4);
+  }
+}
+
+/* This function records where the Subrs count is in the collected text.
+   `pos' is just after it in `line', which is about to be collected. */
 
-  if (c == '%') {
-    while (c != EOF && c != '\r' && c != '\n')
-      c = getc(ifp);
-    get_charstring_token();
+static void collect_subrs_count(const char *line, int pos)
+{
+  int start;
+  while (pos > 0 && isspace((unsigned char) line[pos - 1]))
+    pos--;
+  for (start = pos; start > 0 && isdigit((unsigned char) line[start - 1]);
+       start--)
+    /* nada */;
+  if (start < pos) {
+    subrs_count_pos = font_text_len + start;
+    subrs_count_len = pos - start;
+  }
+}
 
-  } else if (c == '}') {
-    line[0] = '}';
-    line[1] = 0;
+/* This function outputs collected text from `pos' to `end', with the new
+   Subrs count. */
 
-  } else {
-    char *p = line;
-    while (p < line + LINESIZE) {
-      *p++ = c;
-      c = getc(ifp);
-      if (c == EOF || isspace(c) || c == '%' || c == '}') {
-        ungetc(c, ifp);
+static void output_font_text(const struct font_piece *fp, int pos, int end)
+{
+  char buf[16];
+  while (1) {
+    int at = end, len = 0, value = 0;
+    if (subrs_count_pos >= pos && subrs_count_pos < at)
+      at = subrs_count_pos, len = subrs_count_len, value = subrs_count;
+    if (fp->number_len && fp->number_pos >= pos && fp->number_pos < at)
+      at = fp->number_pos, len = fp->number_len, value = fp->number;
+    eexec_text(font_text + pos, at - pos);
+    if (at == end)
+      break;
+    sprintf(buf, "%d", value);
+    eexec_string(buf);
+    pos = at + len;
+  }
+}
+
+/* This function outputs a collected charstring as Subr `subr' or glyph
+   `name', as if it had just been parsed. */
+
+static void output_charstring(const struct t1cs_ir *cs, int subr,
+                              const char *name, int lenIV)
+{
+  int save_lenIV = scan.lenIV;
+
+  charstring_subr = subr;
+  set_charstring_name(name, strlen(name));
+  scan.lenIV = lenIV;
+  charstring_start();
+  ir_reserve((cs->nops > cs->nargs ? cs->nops : cs->nargs) + 1);
+  memcpy(ir.args, cs->args, cs->nargs * sizeof(int32_t));
+  memcpy(ir.argstart, cs->argstart, (cs->nops + 1) * sizeof(int));
+  memcpy(ir.ops, cs->ops, cs->nops * sizeof(unsigned short));
+  ir.nops = cs->nops;
+  ir.nargs = cs->nargs;
+  charstring_output(-1);
+  scan.lenIV = save_lenIV;
+}
+
+/* This function returns where the `dup N ' before a Subr starts in collected
+   text that ends at `end', if it is alone on its line, or -1. It sets
+   `*number_pos' to where `N' starts. */
+
+static int subr_prefix_start(int start, int end, int *number_pos)
+{
+  int p = end;
+  while (p > start && font_text[p - 1] != '\n'
+         && isspace((unsigned char) font_text[p - 1]))
+    p--;
+  if (p == start || !isdigit((unsigned char) font_text[p - 1]))
+    return -1;
+  while (p > start && isdigit((unsigned char) font_text[p - 1]))
+    p--;
+  *number_pos = p;
+  if (p == start || !isspace((unsigned char) font_text[p - 1]))
+    return -1;
+  while (p > start && font_text[p - 1] != '\n'
+         && isspace((unsigned char) font_text[p - 1]))
+    p--;
+  if (p - start < 3 || memcmp(font_text + p - 3, "dup", 3) != 0)
+    return -1;
+  for (p -= 3; p > start && font_text[p - 1] != '\n'; p--)
+    if (!isspace((unsigned char) font_text[p - 1]))
+      return -1;
+  return (p > start || start == 0 || font_text[start - 1] == '\n' ? p : -1);
+}
+
+/* This function returns where the rest of a Subr's line, like ` NP',
+   ends in collected text starting at `pos', if that is one token, or -1. */
+
+static int subr_suffix_end(int pos, int end)
+{
+  int ntok = 0, in_token = 0;
+  for (; pos < end && font_text[pos] != '\n'; pos++) {
+    if (!in_token && !isspace((unsigned char) font_text[pos]))
+      ntok++;
+    in_token = !isspace((unsigned char) font_text[pos]);
+  }
+  return (pos < end && ntok <= 1 ? pos + 1 : -1);
+}
+
+/* With --flatten-subrs or --compact-subrs, this function drops the Subrs
+   no charstring can reach, along with their `dup N ' and ` NP' text. If
+   `renumber' is set, it then numbers the Subrs left after 3 in order, with
+   no gaps, and rewrites their calls. It returns how many Subrs it dropped
+   or renumbered. */
+
+static int drop_unused_subrs(int renumber)
+{
+  unsigned char *used;
+  int *map;
+  int i, n, ok = 1, prefix, suffix, number_pos, dropped = 0;
+
+  if (!(used = (unsigned char *) calloc(font.nsubrs + 1, 1)))
+    fatal_error("out of memory");
+  for (i = 0; i < 4 && i < font.nsubrs; i++)
+    if (font.subrs[i]) {
+      used[i] = 1;
+      ok &= t1cs_mark_subrs(&font, font.subrs[i], used);
+    }
+  for (i = 0; i < font.nglyphs; i++)
+    ok &= t1cs_mark_subrs(&font, font.glyphs[i], used);
+  for (i = 0; i < npieces; i++)
+    if (pieces[i].kind == PIECE_OTHER)
+      ok &= t1cs_mark_subrs(&font, pieces[i].cs, used);
+  if (!ok)
+    error("warning: some Subrs are called indirectly, so none were dropped");
+
+  for (i = 1; ok && i < npieces - 1; i++) {
+    struct font_piece *prev = &pieces[i - 1], *next = &pieces[i + 1];
+    if (pieces[i].kind != PIECE_SUBR || prev->kind != PIECE_TEXT
+        || (prefix = subr_prefix_start(prev->text_pos, prev->text_pos
+                                       + prev->text_len, &number_pos)) < 0)
+      continue;
+    prev->number_pos = number_pos; /* in case the Subr is renumbered */
+    if (used[pieces[i].index] || next->kind != PIECE_TEXT
+        || (suffix = subr_suffix_end(next->text_pos, next->text_pos
+                                     + next->text_len)) < 0)
+      continue;
+    prev->text_len = prefix - prev->text_pos;
+    next->text_len -= suffix - next->text_pos;
+    next->text_pos = suffix;
+    pieces[i].kind = PIECE_NONE;
+    free(font.subrs[pieces[i].index]);
+    font.subrs[pieces[i].index] = 0;
+    dropped++;
+  }
+  free(used);
+  if (!ok || !renumber)
+    return dropped;
+
+  /* number the Subrs left; each one that moves must have its `dup N ' */
+  if (!(map = (int *) malloc((font.nsubrs + 1) * sizeof(int))))
+    fatal_error("out of memory");
+  for (i = n = 0; i < font.nsubrs; i++)
+    if (font.subrs[i] && i >= 4)
+      map[i] = 4 + n++;
+    else
+      map[i] = (font.subrs[i] ? i : -1);
+  for (i = 1; i < npieces; i++)
+    if (pieces[i].kind == PIECE_SUBR && map[pieces[i].index] != pieces[i].index
+        && (pieces[i - 1].kind != PIECE_TEXT || pieces[i - 1].number_pos < 0)) {
+      error("warning: can't find the number of Subr %d, so none were "
+            "renumbered", pieces[i].index);
+      free(map);
+      return dropped;
+    }
+
+  for (i = 0; i < npieces; i++)
+    if (pieces[i].kind == PIECE_OTHER)
+      t1cs_renumber_calls(&font, pieces[i].cs, map);
+  t1cs_renumber_subrs(&font, map);
+  for (i = 0; i < npieces; i++) {
+    struct font_piece *fp = &pieces[i];
+    if (fp->kind == PIECE_SUBR && map[fp->index] != fp->index) {
+      struct font_piece *prev = &pieces[i - 1];
+      for (prev->number_len = 0;
+           isdigit((unsigned char) font_text[prev->number_pos
+                                             + prev->number_len]);
+           prev->number_len++)
+        /* nada */;
+      prev->number = fp->index = map[fp->index];
+      dropped++;
+    }
+  }
+  free(map);
+  return dropped;
+}
+
+/* This function runs the whole-font passes over the collected font, then
+   outputs it. New Subrs go after the last one, each followed by a copy of
+   the text ending the last Subr's line, like ` NP'. */
+
+static void font_output(void)
+{
+  int i, j, nsubrs, last_subr = -1, added = 0, dropped = 0;
+  int suffix_pos = 0, suffix_end = 0;
+  char buf[32];
+
+  collecting = 0;
+  for (i = 0; i < npieces; i++)
+    if (pieces[i].kind == PIECE_SUBR)
+      last_subr = i;
+  for (; font.nsubrs < scan.nsubrs; font.nsubrs++) {
+    int cap = font.subrs_cap * sizeof(struct t1cs_ir *);
+    font.subrs = (struct t1cs_ir **)
+      grow_buffer(font.subrs, &cap,
+                  (font.nsubrs + 1) * sizeof(struct t1cs_ir *));
+    font.subrs_cap = cap / sizeof(struct t1cs_ir *);
+    font.subrs[font.nsubrs] = 0;
+  }
+  if (last_subr >= 0 && last_subr + 1 < npieces
+      && pieces[last_subr + 1].kind == PIECE_TEXT) {
+    struct font_piece *fp = &pieces[last_subr + 1];
+    const char *nl = (const char *) memchr(font_text + fp->text_pos, '\n',
+                                           fp->text_len);
+    suffix_pos = fp->text_pos;
+    suffix_end = (nl ? nl + 1 - font_text : fp->text_pos + fp->text_len);
+  }
+
+  if (flatten_subrs)
+    t1cs_flatten(&font);
+  if (flatten_subrs || compact_subrs)
+    dropped = drop_unused_subrs(compact_subrs);
+  nsubrs = font.nsubrs;
+  if (subroutinize) {
+    if (subrs_count_pos < 0 || suffix_end == 0)
+      error("warning: no Subrs to add to, so not subroutinizing");
+    else {
+      /* `dup N LEN RD ' and ` NP' */
+      font.subr_overhead = 12 + strlen(scan.cs_start)
+        + (suffix_end - suffix_pos)
+        + (pieces[last_subr].lenIV > 0 ? pieces[last_subr].lenIV : 0);
+      added = t1cs_subroutinize(&font);
+    }
+  }
+
+  /* the Subrs count covers the last Subr left */
+  for (subrs_count = font.nsubrs; subrs_count > 0
+         && !font.subrs[subrs_count - 1]; subrs_count--)
+    /* nada */;
+  if (!added && !dropped)
+    subrs_count_pos = -1;
+
+  for (i = 0; i < npieces; i++) {
+    struct font_piece *fp = &pieces[i];
+    int end = fp->text_pos + fp->text_len;
+    switch (fp->kind) {
+
+     case PIECE_TEXT:
+      if (added && i == last_subr + 1) {
+        j = (suffix_end > fp->text_pos ? suffix_end : fp->text_pos);
+        output_font_text(fp, fp->text_pos, j);
+        for (j = nsubrs; j < font.nsubrs; j++) {
+          sprintf(buf, "dup %d ", j);
+          eexec_string(buf);
+          output_charstring(font.subrs[j], j, "", pieces[last_subr].lenIV);
+          eexec_text(font_text + suffix_pos, suffix_end - suffix_pos);
+        }
+        j = (suffix_end > fp->text_pos ? suffix_end : fp->text_pos);
+        output_font_text(fp, j, end);
+      } else
+        output_font_text(fp, fp->text_pos, end);
+      break;
+
+     case PIECE_SUBR:
+      output_charstring(font.subrs[fp->index], fp->index, "", fp->lenIV);
+      break;
+
+     case PIECE_GLYPH:
+      output_charstring(font.glyphs[fp->index], -1, fp->name, fp->lenIV);
+      free(fp->name);
+      break;
+
+     case PIECE_OTHER:
+      output_charstring(fp->cs, -1, "", fp->lenIV);
+      free(fp->cs);
+      break;
+
+    }
+  }
+
+  for (i = 0; i < font.nsubrs; i++)
+    free(font.subrs[i]);
+  for (i = 0; i < font.nglyphs; i++)
+    free(font.glyphs[i]);
+  npieces = font_text_len = font.nsubrs = font.nglyphs = 0;
+  subrs_count_pos = -1;
+}
+
+/* This function reads the text of a charstring, up to the `}' that ends
+   it, into `line'. Comments may contain `}'. It returns 0 if the input ends
+   first. */
+
+static int get_charstring_text(void)
+{
+  int comment = 0;
+
+  line_clear();
+  while (1) {
+    byte *q;
+
+    if (in_pos == in_end) {
+      line_save();
+      if (!fill_input())
+        return 0;
+    }
+
+    for (q = in_pos; q < in_end; q++)
+      if (comment)
+        comment = (*q != '\n' && *q != '\r');
+      else if (*q == '%')
+        comment = 1;
+      else if (*q == '}')
         break;
-      }
+    line_add(in_pos, q - in_pos);
+    in_pos = q;
+    if (q < in_end) {
+      in_pos++;
+      return 1;
     }
-    *p = 0;
   }
 }
 
+/* Charstring token types, returned by get_charstring_token. */
+
+#define TOKEN_END	0	/* end of the charstring */
+#define TOKEN_INT	1	/* integer; value in token_value */
+#define TOKEN_NAME	2	/* anything else */
+
+static const char *token;
+static int token_len;
+static int32_t token_value;
+static char *token_buf;
+static int token_cap = 0;
+
+/* This function returns the current token, null-terminated. */
+
+static char *token_string(void)
+{
+  token_buf = (char *) grow_buffer(token_buf, &token_cap, token_len + 1);
+  memcpy(token_buf, token, token_len);
+  token_buf[token_len] = '\0';
+  return token_buf;
+}
+
+/* This function finds the next token in the charstring text at `*pp',
+   ignoring comments, and classifies it as it is scanned. */
+
+static int get_charstring_token(const char **pp, const char *end)
+{
+  const char *p = *pp;
+  int nondigits = 0;
+
+  /* skip whitespace and comments */
+  while (p < end)
+    if (isspace((unsigned char) *p))
+      p++;
+    else if (*p == '%') {
+      while (p < end && *p != '\r' && *p != '\n')
+        p++;
+    } else
+      break;
+
+  for (token = p; p < end && !isspace((unsigned char) *p) && *p != '%'; p++)
+    nondigits += (unsigned) (*p - '0') > 9;
+  token_len = p - token;
+  *pp = p;
+
+  /* an integer is digits with an optional sign; a lone sign means 0 */
+  if (token_len == 0)
+    return TOKEN_END;
+  else if (nondigits == 0
+           || (nondigits == 1 && (token[0] == '-' || token[0] == '+'))) {
+    const char *s = token + (nondigits != 0);
+    int32_t v = 0;
+    if (p - s > 9)
+      token_value = atoi(token_string());
+    else {
+      for (; s < p; s++)
+        v = 10 * v + *s - '0';
+      token_value = (token[0] == '-' ? -v : v);
+    }
+    return TOKEN_INT;
+  } else
+    return TOKEN_NAME;
+}
+
 
 /* This function parses an entire charstring into integers and commands,
    outputting bytes through the charstring buffer. */
 
 static void parse_charstring(void)
 {
-  struct command *cp;
+  const struct t1cs_op *op;
+  const char *p, *end;
+  int type, closed, cache_index = -1, errors = 0;
+
+  closed = get_charstring_text();
+  if (charstring_cacheable() && closed
+      && (cache_index = charstring_cached(CACHE_TEXT, (byte *) line,
+                                          line_len)) < 0)
+    return;
 
   charstring_start();
-  while (!feof(ifp)) {
-    get_charstring_token();
-    if (line[0] == '}')
-      break;
-    if (is_integer(line)) {
-      charstring_int(atoi(line));
-    } else {
+  p = line;
+  end = line + line_len;
+  while ((type = get_charstring_token(&p, end)) != TOKEN_END) {
+    ir_reserve(1);
+    if (type == TOKEN_INT)
+      t1cs_ir_add_arg(&ir, token_value);
+    else if ((op = t1cs_lookup(token, token_len)))
+      t1cs_ir_add_op(&ir, T1CS_OPCODE(op->one, op->two));
+    else {
+      char *name = token_string();
       int one;
       int two;
       int ok = 0;
 
-      cp = (struct command *)
-        bsearch((void *) line, (void *) command_table,
-                sizeof(command_table) / sizeof(struct command),
-                sizeof(struct command),
-                command_compare);
-
-      if (cp) {
-        one = cp->one;
-        two = cp->two;
-        ok = 1;
-
-      } else if (strncmp(line, "escape_", 7) == 0) {
+      if (token_len > 7 && memcmp(name, "escape_", 7) == 0) {
         /* Parse the `escape' keyword requested by Lee Chun-Yu and Werner
            Lemberg */
         one = 12;
-        if (sscanf(line + 7, "%d", &two) == 1)
+        if (sscanf(name + 7, "%d", &two) == 1)
           ok = 1;
 
-      } else if (strncmp(line, "UNKNOWN_", 8) == 0) {
+      } else if (token_len > 8 && memcmp(name, "UNKNOWN_", 8) == 0) {
         /* Allow unanticipated UNKNOWN commands. */
         one = 12;
-        if (sscanf(line + 8, "12_%d", &two) == 1)
+        if (sscanf(name + 8, "12_%d", &two) == 1)
           ok = 1;
-        else if (sscanf(line + 8, "%d", &one) == 1) {
+        else if (sscanf(name + 8, "%d", &one) == 1) {
           two = -1;
           ok = 1;
         }
       }
 
+      errors++;
       if (!ok)
-        error("unknown charstring command `%s'", line);
+        error("unknown charstring command `%s'", name);
       else if (one < 0 || one > 255)
         error("bad charstring command number `%d'", one);
       else if (two > 255)
         error("bad charstring command number `%d'", two);
-      else if (two < 0)
-        charstring_byte(one);
       else {
-        charstring_byte(one);
-        charstring_byte(two);
+        t1cs_ir_add_op(&ir, T1CS_OPCODE(one, two));
+        errors--;
       }
     }
   }
-  charstring_end();
+  if (!closed)
+    error("charstring not closed before end of input");
+
+  /* keep charstrings with errors out of the cache, so the errors are
+     reported every time */
+  if (errors && cache_index >= 0)
+    cache[cache_index].used = 0;
+  charstring_end(errors ? -1 : cache_index);
+}
+
+/* This function assembles a charstring record from binary input. */
+
+static void binary_charstring(void)
+{
+  const byte *p = record;
+  int i, namelen, nops, nargs, flags, cache_index = -1;
+
+  if (record_len < 6
+      || (namelen = get_int(p + 4, 2)) < 0
+      || record_len < T1R_CHARSTRING_LEN(namelen, 0, 0))
+    goto bad;
+  charstring_subr = get_int(p, 4);
+  set_charstring_name((const char *) p + 6, namelen);
+  p += 6 + namelen;
+  /* the cache key leaves out the Subr number and glyph name */
+  if (charstring_cacheable()
+      && (cache_index = charstring_cached(CACHE_RECORD, p,
+                                          record + record_len - p)) < 0) {
+    record_type = 0;
+    return;
+  }
+  flags = *p++;
+  nops = get_int(p, 4);
+  nargs = get_int(p + 4, 4);
+  p += 8;
+  if (nops < 0 || nargs < 0 || nops > record_len || nargs > record_len
+      || record_len != T1R_CHARSTRING_LEN(namelen, nops, nargs))
+    goto bad;
+
+  charstring_start();
+  ir_reserve((nops > nargs ? nops : nargs) + 1);
+  for (i = 0; i <= nops; i++, p += 4) {
+    ir.argstart[i] = get_int(p, 4);
+    if (ir.argstart[i] < (i ? ir.argstart[i - 1] : 0)
+        || ir.argstart[i] > nargs)
+      goto bad;
+  }
+  if (ir.argstart[0] != 0)
+    goto bad;
+  for (i = 0; i < nops; i++, p += 2)
+    if ((ir.ops[i] = get_int(p, 2) & 0xFFFF) >= T1CS_NOPCODES)
+      goto bad;
+  for (i = 0; i < nargs; i++, p += 4)
+    ir.args[i] = get_int(p, 4);
+  ir.nops = nops;
+  ir.nargs = nargs;
+  /* t1disasm prints `error' after a truncated charstring */
+  if (flags & T1R_TRUNCATED)
+    t1cs_ir_add_op(&ir, CS_error);
+  charstring_end(cache_index);
+  record_type = 0;
+  return;
+
+ bad:
+  fatal_error("bad charstring record in binary input");
 }
 
 
@@ -551,14 +1871,28 @@ static void parse_charstring(void)
 #define HELP_OPT        303
 #define PFB_OPT         304
 #define PFA_OPT         305
+#define CACHE_OPT       306
+#define REUSE_OPT       307
+#define OPTIMIZE_OPT    308
+#define SUBROUTINIZE_OPT 309
+#define FLATTEN_OPT     310
+#define COMPACT_OPT     311
+#define STRIP_HINTS_OPT 312
 
 static Clp_Option options[] = {
   { "block-length", 'l', BLOCK_LEN_OPT, Clp_ValInt, 0 },
+  { "cache", 0, CACHE_OPT, Clp_ValString, 0 },
+  { "compact-subrs", 0, COMPACT_OPT, 0, 0 },
+  { "flatten-subrs", 0, FLATTEN_OPT, 0, 0 },
   { "help", 0, HELP_OPT, 0, 0 },
   { "line-length", 0, BLOCK_LEN_OPT, Clp_ValInt, 0 },
+  { "optimize", 0, OPTIMIZE_OPT, 0, 0 },
   { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
   { "pfa", 'a', PFA_OPT, 0, 0 },
   { "pfb", 'b', PFB_OPT, 0, 0 },
+  { "reuse-from", 0, REUSE_OPT, Clp_ValString, 0 },
+  { "strip-hints", 0, STRIP_HINTS_OPT, 0, 0 },
+  { "subroutinize", 0, SUBROUTINIZE_OPT, 0, 0 },
   { "version", 0, VERSION_OPT, 0, 0 },
 };
 static const char *program_name;
@@ -600,7 +1934,8 @@ usage(void)
   printf("\
 `T1asm' translates a human-readable version of a PostScript Type 1 font into\n\
 standard PFB or PFA format. The result is written to the standard output\n\
-unless an OUTPUT file is given.\n\
+unless an OUTPUT file is given. INPUT may also be in the binary format\n\
+written by `t1disasm --format=binary'.\n\
 \n\
 Usage: %s [OPTION]... [INPUT [OUTPUT]]\n\
 \n\
@@ -611,6 +1946,16 @@ Options:\n\
   -l, --block-length NUM      Set max block length for PFB output.\n\
   -l, --line-length NUM       Set max encrypted line length for PFA output.\n\
   -o, --output=FILE           Write output to FILE.\n\
+      --cache=FILE            Reuse encrypted charstrings from FILE, and\n\
+                              save this font's charstrings there.\n\
+      --reuse-from=FONT       Copy unchanged charstrings from the original\n\
+                              FONT (PFA or PFB) without re-encrypting.\n\
+      --optimize              Rewrite charstrings with shorter commands.\n\
+      --subroutinize          Move repeated commands into new Subrs.\n\
+      --flatten-subrs         Inline Subrs at their calls, then drop unused\n\
+                              Subrs.\n\
+      --compact-subrs         Drop unused Subrs and renumber the rest.\n\
+      --strip-hints           Remove hints from charstrings and Private.\n\
   -h, --help                  Print this message and exit.\n\
       --version               Print version number and warranty and exit.\n\
 \n\
@@ -624,7 +1969,8 @@ Report bugs to <ekohler@gmail.com>.\n", program_name);
 
 int main(int argc, char *argv[])
 {
-  char *p, *q;
+  char *p, *q, *end;
+  const char *reuse_file = 0;
 
   Clp_Parser *clp =
     Clp_NewParser(argc, (const char * const *)argv, sizeof(options) / sizeof(options[0]), options);
@@ -657,6 +2003,34 @@ int main(int argc, char *argv[])
       pfb = 0;
       break;
 
+     case CACHE_OPT:
+      cache_file = clp->vstr;
+      break;
+
+     case REUSE_OPT:
+      reuse_file = clp->vstr;
+      break;
+
+     case OPTIMIZE_OPT:
+      optimize = 1;
+      break;
+
+     case SUBROUTINIZE_OPT:
+      subroutinize = 1;
+      break;
+
+     case FLATTEN_OPT:
+      flatten_subrs = 1;
+      break;
+
+     case COMPACT_OPT:
+      compact_subrs = 1;
+      break;
+
+     case STRIP_HINTS_OPT:
+      strip_hints = 1;
+      break;
+
      case HELP_OPT:
       usage();
       exit(0);
@@ -717,90 +2091,115 @@ particular purpose.\n");
   /* file, we must set its file mode to binary. */
   if (pfb)
     _setmode(_fileno(ofp), _O_BINARY);
+  /* Input may be in t1disasm's binary format. Text input is unaffected,
+     since t1utils_getline handles CR LF. */
+  _setmode(_fileno(ifp), _O_BINARY);
 #endif
 
-  /* Finally, we loop until no more input. Some special things to look for are
-     the `currentfile eexec' line, the beginning of the `/Subrs' or
-     `/CharStrings' definition, the definition of `/lenIV', and the definition
-     of the charstring start command which has `...string currentfile...' in
-     it.
-
-     Being careful: Check with `/Subrs' and `/CharStrings' to see that a
-     number follows the token -- otherwise, the token is probably nested in a
-     subroutine a la Adobe Jenson, and we shouldn't pay attention to it.
-
-     Bugs: Occurrence of `/Subrs 9' in a comment will fool t1asm.
+  binary_input = check_binary_input();
+  if (cache_file && collecting_options()) {
+    error("warning: --cache has no effect with %s", collecting_options());
+    cache_file = 0;
+  }
+  if (cache_file)
+    cache_load();
+  if (reuse_file)
+    reuse_load(reuse_file);
+
+  /* Finally, we loop until no more input. Each line goes through the
+     scanner, which tracks `/lenIV', the definition of the charstring start
+     command (the procedure with `...string currentfile...' in it), and
+     reports the beginning of the `/Subrs' or `/CharStrings' definition and
+     `currentfile closefile'. The `currentfile eexec' line is special.
+
+     Being careful: The scanner only reports `/Subrs' and `/CharStrings'
+     when a number follows the token outside any procedure -- otherwise, the
+     token is probably nested in a subroutine a la Adobe Jenson, and we
+     shouldn't pay attention to it.
 
      Thanks to Tom Kacvinsky <tjk@ams.org> who reported that some fonts come
      without /Subrs sections and provided a patch. */
 
-  while (!feof(ifp) && !ferror(ifp)) {
-    t1utils_getline();
+  t1scan_init(&scan);
+  line_buf = (char *) grow_buffer(line_buf, &line_cap, 1);
 
-    if (!ever_active) {
-      if (strncmp(line, "currentfile eexec", 17) == 0 && isspace((unsigned char) line[17])) {
-        /* Allow arbitrary whitespace after "currentfile eexec".
-           Thanks to Tom Kacvinsky <tjk@ams.org> for reporting this.
-           Note: strlen("currentfile eexec") == 17. */
-        for (p = line + 18; isspace((unsigned char) *p); p++)
-          ;
-        eexec_start(p);
-        continue;
-      } else if (strncmp(line, "/lenIV", 6) == 0) {
-        set_lenIV(line, strlen(line));
-      } else if ((p = strstr(line, "string currentfile"))) {
-        set_cs_start(line, strlen(line));
-      }
+  while (!input_done()) {
+    t1utils_getline();
+    end = line + line_len;
+
+    if (!ever_active && line_len > 17
+        && memcmp(line, "currentfile eexec", 17) == 0
+        && isspace((unsigned char) line[17])) {
+      /* Allow arbitrary whitespace after "currentfile eexec".
+         Thanks to Tom Kacvinsky <tjk@ams.org> for reporting this.
+         Note: strlen("currentfile eexec") == 17. */
+      for (p = line + 18; p < end && isspace((unsigned char) *p); p++)
+        ;
+      eexec_start(p, end - p);
+      continue;
     }
 
-    if (!active) {
-      if ((p = strstr(line, "/Subrs")) && isdigit((unsigned char) p[7]))
-        ever_active = active = 1;
-      else if ((p = strstr(line, "/CharStrings")) && isdigit((unsigned char) p[13]))
-        ever_active = active = 1;
-    }
-    if ((p = strstr(line, "currentfile closefile"))) {
+    scan.events = 0;
+    t1scan_feed(&scan, (const unsigned char *) line, line_len);
+
+    if (!active && (scan.events & (T1SCAN_EV_SUBRS | T1SCAN_EV_CHARSTRINGS)))
+      ever_active = active = 1;
+    if (collecting && (scan.events & T1SCAN_EV_SUBRS))
+      collect_subrs_count(line, scan.event_pos);
+    if (scan.events & T1SCAN_EV_CLOSEFILE) {
       /* 2/14/99 -- happy Valentine's day! -- don't look for `mark
          currentfile closefile'; the `mark' might be on a different line */
       /* 1/3/2002 -- happy new year! -- Luc Devroye reports a failure with
          some printers when `currentfile closefile' is followed by space */
-      p += sizeof("currentfile closefile") - 1;
-      for (q = p; isspace((unsigned char) *q) && *q != '\n'; q++)
+      p = line + scan.event_pos;
+      for (q = p; q < end && isspace((unsigned char) *q) && *q != '\n'; q++)
         /* nada */;
-      if (q == p && !*q)
-        error("warning: `currentfile closefile' line too long");
-      else if (q != p) {
-        if (*q != '\n')
+      if (q != p) {
+        if (q == end || *q != '\n')
           error("text after `currentfile closefile' ignored");
         *p++ = '\n';
-        *p++ = '\0';
+        line_len = p - line;
       }
-      eexec_string(line);
+      if (collecting)
+        font_output();
+      eexec_text(line, line_len);
       break;
     }
 
-    eexec_string(line);
+    if (strip_hints && in_eexec && !active)
+      strip_hint_entry();
+    eexec_text(line, line_len);
 
     /* output line data */
     if (start_charstring) {
-      if (!cs_start[0])
+      if (!scan.cs_start[0])
         fatal_error("couldn't find charstring start command");
-      parse_charstring();
+      if (binary_input)
+        binary_charstring();
+      else {
+        charstring_key(line, line_len);
+        parse_charstring();
+      }
     }
   }
 
   /* Handle remaining PostScript after the eexec section */
+  if (collecting)
+    font_output();
+  flush_pending();
   if (in_eexec)
     eexec_end();
 
   /* There may be additional code. */
-  while (!feof(ifp) && !ferror(ifp)) {
+  while (!input_done()) {
     t1utils_getline();
-    eexec_string(line);
+    eexec_text(line, line_len);
   }
 
   if (pfb)
     pfb_writer_end(&w);
+  if (cache_file)
+    cache_save();
 
   /* the end! */
   if (!ever_active)
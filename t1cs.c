@@ -0,0 +1,569 @@
+/* t1cs
+ *
+ * This file contains the charstring operator table shared by t1asm and
+ * t1disasm, with constant-time lookups by opcode and by name.
+ *
+ * Copyright (c) 1998-2017 Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, subject to the
+ * conditions listed in the Click LICENSE file, which is available in full at
+ * http://github.com/kohler/click/blob/master/LICENSE. The conditions
+ * include: you must preserve this copyright notice, and you cannot mention
+ * the copyright holders in advertising related to the Software without
+ * their permission. The Software is provided WITHOUT ANY WARRANTY, EXPRESS
+ * OR IMPLIED. This notice is a summary of the Click LICENSE file; the
+ * license in that file is binding.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "t1lib.h"
+#include "t1cs.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const struct t1cs_op t1cs_ops[] = {
+#define T1CS_OP(name, one, two, args1, args2, flags) \
+    { #name, sizeof(#name) - 1, one, two, args1, args2, flags },
+#include "t1csops.h"
+#undef T1CS_OP
+};
+
+const int t1cs_nops = sizeof(t1cs_ops) / sizeof(t1cs_ops[0]);
+
+/* decode_table is indexed by opcode. Names are found with a minimal
+   perfect hash built by t1cs_init, using hash-and-displace: a name's hash
+   picks a bucket, and that bucket's displacement, mixed into the hash,
+   picks the name's slot in name_table. Every operator gets its own slot,
+   and there are no empty slots. */
+
+#define NOPS		((int) (sizeof(t1cs_ops) / sizeof(t1cs_ops[0])))
+#define NAME_BUCKETS	16
+
+static const struct t1cs_op *decode_table[T1CS_NOPCODES];
+static unsigned char name_table[NOPS];
+static uint32_t name_displace[NAME_BUCKETS];
+static int initialized = 0;
+
+static uint32_t
+name_hash(const char *name, int len)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261U;
+    for (; len > 0; name++, len--)
+	h = (h ^ (unsigned char) *name) * 16777619U;
+    return h;
+}
+
+static int
+name_slot(uint32_t h, uint32_t displace)
+{
+    h ^= displace * 0x9E3779B9U;
+    h = (h ^ (h >> 16)) * 0x85EBCA6BU;
+    h = (h ^ (h >> 13)) * 0xC2B2AE35U;
+    return (h ^ (h >> 16)) % NOPS;
+}
+
+void
+t1cs_init(void)
+{
+    uint32_t hash[NOPS];
+    int order[NAME_BUCKETS], size[NAME_BUCKETS];
+    int i, j, k, b;
+
+    if (initialized)
+	return;
+
+    for (i = 0; i < t1cs_nops; i++)
+	if (!(t1cs_ops[i].flags & T1CS_ALIAS))
+	    decode_table[T1CS_OPCODE(t1cs_ops[i].one, t1cs_ops[i].two)]
+		= &t1cs_ops[i];
+    /* bare `escape' is never decoded: byte 12 always introduces an escape */
+    decode_table[12] = 0;
+
+    /* place the fullest buckets first, while most slots are free */
+    memset(size, 0, sizeof(size));
+    for (i = 0; i < NOPS; i++) {
+	hash[i] = name_hash(t1cs_ops[i].name, t1cs_ops[i].namelen);
+	size[hash[i] % NAME_BUCKETS]++;
+    }
+    for (b = 0; b < NAME_BUCKETS; b++) {
+	for (j = b; j > 0 && size[order[j - 1]] < size[b]; j--)
+	    order[j] = order[j - 1];
+	order[j] = b;
+    }
+
+    memset(name_table, 0, sizeof(name_table));
+    for (k = 0; k < NAME_BUCKETS; k++) {
+	uint32_t d;
+	b = order[k];
+	for (d = 0; ; d++) {
+	    for (i = 0; i < NOPS; i++)
+		if (hash[i] % NAME_BUCKETS == (uint32_t) b) {
+		    int slot = name_slot(hash[i], d);
+		    if (name_table[slot])
+			break;
+		    name_table[slot] = i + 1;
+		}
+	    if (i == NOPS)
+		break;
+	    /* collision: undo this bucket's placements and try again */
+	    for (j = 0; j < i; j++)
+		if (hash[j] % NAME_BUCKETS == (uint32_t) b)
+		    name_table[name_slot(hash[j], d)] = 0;
+	}
+	name_displace[b] = d;
+    }
+
+    initialized = 1;
+}
+
+const struct t1cs_op *
+t1cs_decode(int opcode)
+{
+    if (!initialized)
+	t1cs_init();
+    if (opcode < 0 || opcode >= T1CS_NOPCODES)
+	return 0;
+    return decode_table[opcode];
+}
+
+const struct t1cs_op *
+t1cs_lookup(const char *name, int len)
+{
+    const struct t1cs_op *op;
+    uint32_t h;
+    if (!initialized)
+	t1cs_init();
+    h = name_hash(name, len);
+    op = &t1cs_ops[name_table[name_slot(h, name_displace[h % NAME_BUCKETS])]
+		   - 1];
+    if (op->namelen != len || memcmp(op->name, name, len) != 0)
+	return 0;
+    return op;
+}
+
+
+
+/*****
+ * Decoded charstrings
+ **/
+
+void
+t1cs_ir_init(struct t1cs_ir *ir, void *arena, int n)
+{
+    char *p = (char *) arena;
+    ir->args = (int32_t *) p;
+    p += n * sizeof(int32_t);
+    ir->argstart = (int *) p;
+    p += (n + 1) * sizeof(int);
+    ir->ops = (unsigned short *) p;
+    t1cs_ir_clear(ir);
+}
+
+struct t1cs_ir *
+t1cs_ir_new(int n)
+{
+    struct t1cs_ir *ir;
+    if (n < 1)
+	n = 1;
+    if (!(ir = (struct t1cs_ir *) malloc(sizeof(struct t1cs_ir)
+					  + T1CS_ARENA_SIZE(n))))
+	fatal_error("out of memory");
+    t1cs_ir_init(ir, ir + 1, n);
+    return ir;
+}
+
+struct t1cs_ir *
+t1cs_ir_copy(const struct t1cs_ir *ir)
+{
+    struct t1cs_ir *copy = t1cs_ir_new(ir->nops > ir->nargs ? ir->nops
+				       : ir->nargs);
+    memcpy(copy->args, ir->args, ir->nargs * sizeof(int32_t));
+    memcpy(copy->argstart, ir->argstart, (ir->nops + 1) * sizeof(int));
+    memcpy(copy->ops, ir->ops, ir->nops * sizeof(unsigned short));
+    copy->nops = ir->nops;
+    copy->nargs = ir->nargs;
+    copy->truncated = ir->truncated;
+    return copy;
+}
+
+void
+t1cs_decode_charstring(struct t1cs_ir *ir, const unsigned char *cs, int len)
+{
+    const unsigned char *end = cs + len;
+    int32_t val;
+
+    t1cs_ir_clear(ir);
+    while (cs < end) {
+	int b = *cs++;
+
+	if (b >= 32 && b <= 246)
+	    val = b - 139;
+	else if (b >= 247 && b <= 254) {
+	    if (cs == end)
+		goto truncated;
+	    if (b <= 250)
+		val = (b - 247)*256 + 108 + *cs++;
+	    else
+		val = -(b - 251)*256 - 108 - *cs++;
+	} else if (b == 255) {
+	    uint32_t uval;
+	    if (end - cs < 4)
+		goto truncated;
+	    uval =  (uint32_t) cs[0] << 24;
+	    uval |= (uint32_t) cs[1] << 16;
+	    uval |= (uint32_t) cs[2] <<  8;
+	    uval |= (uint32_t) cs[3] <<  0;
+	    /* in case an int32 is larger than four bytes---sign extend */
+#if INT_MAX > 0x7FFFFFFFUL
+	    if (uval & 0x80000000U)
+		uval |= ~0x7FFFFFFFU;
+#endif
+	    val = (int32_t) uval;
+	    cs += 4;
+	} else if (b == 28) {
+	    /* Type 2 short integer */
+	    if (end - cs < 2)
+		goto truncated;
+	    val = (cs[0] << 8) | cs[1];
+	    if (val & 0x8000)
+		val |= ~0x7FFF;
+	    cs += 2;
+	} else if (b == 12) {
+	    if (cs == end)
+		goto truncated;
+	    t1cs_ir_add_op(ir, T1CS_OPCODE(12, *cs));
+	    cs++;
+	    continue;
+	} else {
+	    t1cs_ir_add_op(ir, b);
+	    continue;
+	}
+
+	t1cs_ir_add_arg(ir, val);
+    }
+    return;
+
+  truncated:
+    ir->truncated = 1;
+}
+
+static unsigned char *
+encode_int(unsigned char *out, int32_t num)
+{
+    if (num >= -107 && num <= 107)
+	*out++ = (unsigned char) (num + 139);
+    else if (num >= 108 && num <= 1131) {
+	num -= 108;
+	*out++ = (unsigned char) (num / 256 + 247);
+	*out++ = (unsigned char) (num % 256);
+    } else if (num >= -1131 && num <= -108) {
+	num = -num - 108;
+	*out++ = (unsigned char) (num / 256 + 251);
+	*out++ = (unsigned char) (num % 256);
+    } else {
+	*out++ = 255;
+	*out++ = (unsigned char) (num >> 24);
+	*out++ = (unsigned char) (num >> 16);
+	*out++ = (unsigned char) (num >> 8);
+	*out++ = (unsigned char) num;
+    }
+    return out;
+}
+
+int
+t1cs_encode_charstring(const struct t1cs_ir *ir, unsigned char *out)
+{
+    unsigned char *start = out;
+    int i, a = 0;
+
+    for (i = 0; i < ir->nops; i++) {
+	for (; a < ir->argstart[i + 1]; a++)
+	    out = encode_int(out, ir->args[a]);
+	if (ir->ops[i] >= 256) {
+	    *out++ = 12;
+	    *out++ = (unsigned char) (ir->ops[i] - 256);
+	} else
+	    *out++ = (unsigned char) ir->ops[i];
+    }
+    for (; a < ir->nargs; a++)
+	out = encode_int(out, ir->args[a]);
+
+    return out - start;
+}
+
+int
+t1cs_op_len(const struct t1cs_ir *ir, int i)
+{
+    int a, len = (ir->ops[i] >= 256 ? 2 : 1);
+    for (a = ir->argstart[i]; a < ir->argstart[i + 1]; a++)
+	if (ir->args[a] >= -107 && ir->args[a] <= 107)
+	    len++;
+	else if (ir->args[a] >= -1131 && ir->args[a] <= 1131)
+	    len += 2;
+	else
+	    len += 5;
+    return len;
+}
+
+
+
+/*****
+ * Peephole optimization
+ **/
+
+/* An operand is known only if the stack was empty before its operator's
+   operands were pushed. Type 1 path and hint operators clear the stack;
+   callsubr, div and pop may leave values on it. */
+
+int
+t1cs_clears_stack(int opcode)
+{
+    const struct t1cs_op *op = t1cs_decode(opcode);
+    return op && (op->flags & T1CS_TYPE1) && !(op->flags & T1CS_SPECIAL)
+	&& op->args1 >= 0 && opcode != CS_callsubr && opcode != CS_return
+	&& opcode != CS_div && opcode != CS_pop;
+}
+
+static int
+has_args(const struct t1cs_ir *ir, int i, int opcode, int n)
+{
+    return ir->ops[i] == opcode && ir->argstart[i + 1] - ir->argstart[i] == n;
+}
+
+/* This function returns 1 if op `i' is a move with all its operands. */
+
+static int
+is_move(const struct t1cs_ir *ir, int i)
+{
+    return has_args(ir, i, CS_rmoveto, 2) || has_args(ir, i, CS_hmoveto, 1)
+	|| has_args(ir, i, CS_vmoveto, 1);
+}
+
+static int
+fits_int32(int64_t x)
+{
+    return x >= -2147483647 - 1 && x <= 2147483647;
+}
+
+static int
+is_stem(int opcode)
+{
+    return opcode == CS_hstem || opcode == CS_vstem || opcode == CS_hstem3
+	|| opcode == CS_vstem3;
+}
+
+void
+t1cs_optimize(struct t1cs_ir *ir, int stack_empty)
+{
+    int i, k, ra = 0, nops = 0, nargs = 0, hints = 0, in_flex = 0;
+
+#define EMIT(opcode, vals, n) do {					\
+	memmove(ir->args + nargs, (vals), (n) * sizeof(int32_t));	\
+	nargs += (n);							\
+	ir->ops[nops] = (opcode);					\
+	ir->argstart[++nops] = nargs;					\
+    } while (0)
+
+    for (i = 0; i < ir->nops; i++) {
+	const struct t1cs_op *op = t1cs_decode(ir->ops[i]);
+	int opcode = ir->ops[i], end = ir->argstart[i + 1], n = end - ra;
+	int32_t v[6];
+
+	if (!stack_empty || in_flex || !op || n != op->args1 || n > 6) {
+	    EMIT(opcode, ir->args + ra, n);
+	    goto next;
+	}
+	memcpy(v, ir->args + ra, n * sizeof(int32_t));
+
+	if (opcode == CS_rmoveto || opcode == CS_hmoveto
+	    || opcode == CS_vmoveto) {
+	    int64_t dx = 0, dy = 0;
+	    for (k = i; ; k++) {
+		/* argstart[i] may already hold output */
+		const int32_t *a = (k == i ? v : ir->args + ir->argstart[k]);
+		if (ir->ops[k] == CS_rmoveto)
+		    dx += a[0], dy += a[1];
+		else if (ir->ops[k] == CS_hmoveto)
+		    dx += a[0];
+		else
+		    dy += a[0];
+		if (k + 1 == ir->nops || !is_move(ir, k + 1))
+		    break;
+	    }
+	    /* moves whose sum doesn't fit in an operand stay apart */
+	    if (!fits_int32(dx) || !fits_int32(dy)) {
+		EMIT(opcode, v, n);
+		goto next;
+	    }
+	    i = k;
+	    end = ir->argstart[i + 1];
+	    /* a null move just before endchar does nothing */
+	    if (dx == 0 && dy == 0 && i + 1 < ir->nops
+		&& ir->ops[i + 1] == CS_endchar)
+		goto next;
+	    v[0] = (int32_t) dx;
+	    v[1] = (int32_t) dy;
+	    if (dy == 0)
+		EMIT(CS_hmoveto, v, 1);
+	    else if (dx == 0)
+		EMIT(CS_vmoveto, v + 1, 1);
+	    else
+		EMIT(CS_rmoveto, v, 2);
+
+	} else if (opcode == CS_rlineto && v[1] == 0)
+	    EMIT(CS_hlineto, v, 1);
+	else if (opcode == CS_rlineto && v[0] == 0)
+	    EMIT(CS_vlineto, v + 1, 1);
+	else if (opcode == CS_rrcurveto && v[1] == 0 && v[4] == 0) {
+	    /* dx1 0 dx2 dy2 0 dy3 rrcurveto == dx1 dx2 dy2 dy3 hvcurveto */
+	    v[1] = v[2];
+	    v[2] = v[3];
+	    v[3] = v[5];
+	    EMIT(CS_hvcurveto, v, 4);
+	} else if (opcode == CS_rrcurveto && v[0] == 0 && v[5] == 0)
+	    /* 0 dy1 dx2 dy2 dx3 0 rrcurveto == dy1 dx2 dy2 dx3 vhcurveto */
+	    EMIT(CS_vhcurveto, v + 1, 4);
+	else if (is_stem(opcode)) {
+	    /* drop a stem already in the current hint set */
+	    for (k = hints; k < nops; k++)
+		if (ir->ops[k] == opcode
+		    && ir->argstart[k + 1] - ir->argstart[k] == n
+		    && memcmp(ir->args + ir->argstart[k], v,
+			      n * sizeof(int32_t)) == 0)
+		    break;
+	    if (k == nops)
+		EMIT(opcode, v, n);
+	} else
+	    EMIT(opcode, v, n);
+
+      next:
+	/* Flex runs from othersubr 1 to othersubr 0. Othersubrs and
+	   subroutines may replace hints, which starts a new hint set. */
+	if (opcode == CS_callothersubr && n > 0) {
+	    int32_t othersubr = ir->args[end - 1];
+	    if (othersubr == 1)
+		in_flex = 1;
+	    else if (othersubr == 0)
+		in_flex = 0;
+	    hints = nops;
+	} else if (opcode == CS_callsubr)
+	    hints = nops;
+	stack_empty = t1cs_clears_stack(opcode);
+	ra = end;
+    }
+
+    /* numbers after the last operator */
+    memmove(ir->args + nargs, ir->args + ra,
+	    (ir->nargs - ra) * sizeof(int32_t));
+    ir->nops = nops;
+    ir->nargs = nargs + ir->nargs - ra;
+#undef EMIT
+}
+
+
+
+/*****
+ * Hint stripping
+ **/
+
+int
+t1cs_is_hint_subr(const struct t1cs_ir *ir)
+{
+    return ir->nops == 4 && ir->nargs == 2
+	&& has_args(ir, 0, CS_callothersubr, 2) && ir->args[0] == 1
+	&& ir->args[1] == 3 && has_args(ir, 1, CS_pop, 0)
+	&& has_args(ir, 2, CS_callsubr, 0) && has_args(ir, 3, CS_return, 0);
+}
+
+/* This function returns 1 if `ir' holds only complete hints and a final
+   `return'. Such a Subr is a hint set for hint replacement, which calls it
+   with an empty stack. */
+
+static int
+is_hint_set(const struct t1cs_ir *ir)
+{
+    int i;
+    if (ir->nops == 0 || !has_args(ir, ir->nops - 1, CS_return, 0)
+	|| ir->nargs != ir->argstart[ir->nops])
+	return 0;
+    for (i = 0; i < ir->nops - 1; i++) {
+	const struct t1cs_op *op = t1cs_decode(ir->ops[i]);
+	if (!(is_stem(ir->ops[i]) || ir->ops[i] == CS_dotsection)
+	    || !has_args(ir, i, ir->ops[i], op->args1))
+	    return 0;
+    }
+    return 1;
+}
+
+/* This function returns the number of ops starting at op i, whose operands
+   start at `ra', that replace hints: `N 1 3 callothersubr pop callsubr', or
+   `N S callsubr' where S is a hint replacement Subr. It returns 0 if they
+   don't. Either form leaves the stack as it was. */
+
+static int
+hint_replacement_len(const struct t1cs_ir *ir, int i, int ra,
+		     const unsigned char *hint_subrs, int nhint_subrs)
+{
+    int n = ir->argstart[i + 1] - ra;
+    if (ir->ops[i] == CS_callothersubr && n == 3 && ir->args[ra + 1] == 1
+	&& ir->args[ra + 2] == 3 && i + 2 < ir->nops
+	&& has_args(ir, i + 1, CS_pop, 0) && has_args(ir, i + 2, CS_callsubr, 0))
+	return 3;
+    if (ir->ops[i] == CS_callsubr && n == 2 && ir->args[ra + 1] >= 0
+	&& ir->args[ra + 1] < nhint_subrs && hint_subrs[ir->args[ra + 1]])
+	return 1;
+    return 0;
+}
+
+void
+t1cs_strip_hints(struct t1cs_ir *ir, int stack_empty,
+		 const unsigned char *hint_subrs, int nhint_subrs)
+{
+    int i, k, ra = 0, nops = 0, nargs = 0;
+
+    if (!stack_empty && is_hint_set(ir))
+	stack_empty = 1;
+
+    for (i = 0; i < ir->nops; i++) {
+	const struct t1cs_op *op = t1cs_decode(ir->ops[i]);
+	int opcode = ir->ops[i], end = ir->argstart[i + 1], n = end - ra;
+
+	/* argstart[i] may already hold output, so operands start at `ra' */
+	if (stack_empty && op && n == op->args1
+	    && (is_stem(opcode) || opcode == CS_dotsection))
+	    /* the stack stays empty */;
+	else if ((k = hint_replacement_len(ir, i, ra, hint_subrs,
+					   nhint_subrs)) > 0) {
+	    /* the stack is left as it was */
+	    i += k - 1;
+	    end = ir->argstart[i + 1];
+	} else {
+	    memmove(ir->args + nargs, ir->args + ra, n * sizeof(int32_t));
+	    nargs += n;
+	    ir->ops[nops] = opcode;
+	    ir->argstart[++nops] = nargs;
+	    stack_empty = t1cs_clears_stack(opcode);
+	}
+	ra = end;
+    }
+
+    /* numbers after the last operator */
+    memmove(ir->args + nargs, ir->args + ra,
+	    (ir->nargs - ra) * sizeof(int32_t));
+    ir->nops = nops;
+    ir->nargs = nargs + ir->nargs - ra;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,130 @@
+#ifndef T1CS_H
+#define T1CS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Charstring operator descriptors for Type 1 and Type 2 charstrings,
+   generated from t1csops.h. */
+
+#define T1CS_TYPE1	0x01
+#define T1CS_TYPE2	0x02
+#define T1CS_ALIAS	0x04	/* alternate name, never output */
+#define T1CS_SPECIAL	0x08	/* `error' and bare `escape' */
+
+#define T1CS_NOARGS	(-2)	/* arity of an operator missing from a type */
+
+/* Opcodes number one-byte operators by their byte, 0-255, and escaped
+   operators 256-511. */
+#define T1CS_OPCODE(one, two)	((two) < 0 ? (one) : 256 + (two))
+#define T1CS_NOPCODES		512
+
+enum t1cs_opcode {
+#define T1CS_OP(name, one, two, args1, args2, flags) \
+    CS_##name = T1CS_OPCODE(one, two),
+#include "t1csops.h"
+#undef T1CS_OP
+    CS_NONE = -1
+};
+
+struct t1cs_op {
+  const char *name;
+  int namelen;
+  int one;
+  int two;                      /* -1 unless one == 12 */
+  int args1;                    /* Type 1 arity */
+  int args2;                    /* Type 2 arity */
+  int flags;
+};
+
+extern const struct t1cs_op t1cs_ops[];
+extern const int t1cs_nops;
+
+/* t1cs_init builds the lookup tables; the lookup functions call it if
+   necessary, but threaded programs should call it first. */
+void t1cs_init(void);
+
+/* returns the operator with that opcode, or null if none */
+const struct t1cs_op *t1cs_decode(int opcode);
+
+/* returns the operator with that name, or null if none */
+const struct t1cs_op *t1cs_lookup(const char *name, int len);
+
+
+/* A decoded charstring. ops[i] is the opcode of the i'th operator, whose
+   operands are args[argstart[i]] through args[argstart[i+1] - 1]. Numbers
+   after the last operator start at args[argstart[nops]]. */
+
+struct t1cs_ir {
+  int nops;
+  int nargs;
+  unsigned short *ops;
+  int *argstart;                /* nops + 1 entries */
+  int32_t *args;
+  int truncated;                /* 1 if the charstring ended mid-token */
+};
+
+/* An arena of T1CS_ARENA_SIZE(n) bytes holds the decoding of any
+   charstring of up to n bytes, or of up to n operators and n operands. */
+#define T1CS_ARENA_SIZE(n) \
+  ((size_t) (n) * sizeof(int32_t) + ((size_t) (n) + 1) * sizeof(int) \
+   + (size_t) (n) * sizeof(unsigned short))
+
+/* Charstrings encode to at most this many bytes. */
+#define T1CS_ENCODED_SIZE(ir)	(5 * (ir)->nargs + 2 * (ir)->nops)
+
+void t1cs_ir_init(struct t1cs_ir *, void *arena, int n);
+
+/* Returns a malloc'ed charstring, to be freed with free(), with room for n
+   operators and n operands, or a copy of another. */
+struct t1cs_ir *t1cs_ir_new(int n);
+struct t1cs_ir *t1cs_ir_copy(const struct t1cs_ir *);
+
+#define t1cs_ir_clear(ir) \
+  ((ir)->nops = (ir)->nargs = (ir)->truncated = 0, (ir)->argstart[0] = 0)
+#define t1cs_ir_add_arg(ir, v) \
+  ((ir)->args[(ir)->nargs++] = (v))
+#define t1cs_ir_add_op(ir, opcode) \
+  ((ir)->ops[(ir)->nops++] = (opcode), \
+   (ir)->argstart[(ir)->nops] = (ir)->nargs)
+
+/* Decodes a plaintext charstring, without lenIV bytes, into `ir', which
+   must have room for `len' bytes. */
+void t1cs_decode_charstring(struct t1cs_ir *, const unsigned char *cs,
+			    int len);
+
+/* Encodes `ir' into `out' and returns the number of bytes written. */
+int t1cs_encode_charstring(const struct t1cs_ir *, unsigned char *out);
+
+/* returns the encoded length of operator i and its operands */
+int t1cs_op_len(const struct t1cs_ir *, int i);
+
+/* returns 1 if the Type 1 operator always leaves the stack empty */
+int t1cs_clears_stack(int opcode);
+
+/* Rewrites `ir' in place with equivalent, shorter Type 1 commands: rlineto
+   and rrcurveto become their horizontal and vertical forms, consecutive
+   moves are merged, a null move before endchar is dropped, and repeated
+   stems in a hint set are dropped. Set `stack_empty' for a glyph; Subrs
+   may start with operands on the stack. Flex is left alone. */
+void t1cs_optimize(struct t1cs_ir *, int stack_empty);
+
+/* Returns 1 if `ir' is a hint replacement Subr, `1 3 callothersubr pop
+   callsubr return', which charstrings call as `N S callsubr' to replace
+   hints with those in Subr N. Adobe fonts use Subr 4. */
+int t1cs_is_hint_subr(const struct t1cs_ir *);
+
+/* Removes hstem, vstem, hstem3, vstem3, dotsection and hint replacement
+   (`N 1 3 callothersubr pop callsubr', or `N S callsubr' where
+   hint_subrs[S] is set) from `ir' in place, leaving hsbw, sbw and the
+   outline. A stem or dotsection is kept unless the stack is known to be
+   empty before its operands, since a Subr may leave values there; a Subr
+   made only of hints is taken to be a hint set, and stripped whole.
+   `stack_empty' is as for t1cs_optimize. */
+void t1cs_strip_hints(struct t1cs_ir *, int stack_empty,
+		      const unsigned char *hint_subrs, int nhint_subrs);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,89 @@
+/* t1csops.h -- the charstring operator list
+ *
+ * This file is included several times with different definitions of
+ * T1CS_OP(name, one, two, args1, args2, flags):
+ *
+ *   name	the operator's name in t1disasm output
+ *   one, two	its encoding: `one' alone if `two' is -1, otherwise the
+ *		escape byte 12 followed by `two'
+ *   args1	operands popped in Type 1 charstrings (-1: variable)
+ *   args2	operands popped in Type 2 charstrings (-1: variable)
+ *   flags	T1CS_TYPE1, T1CS_TYPE2, T1CS_ALIAS, T1CS_SPECIAL
+ *
+ * Arity doesn't count the operands of a called subroutine. Operators that
+ * don't exist in a charstring type have arity T1CS_NOARGS there. */
+
+#ifndef T1CS_OP
+# error "define T1CS_OP before including t1csops.h"
+#endif
+
+#define T1CS_BOTH	(T1CS_TYPE1 | T1CS_TYPE2)
+#define NA		T1CS_NOARGS
+
+T1CS_OP(error,		0, -1,	0, 0,	T1CS_BOTH | T1CS_SPECIAL)
+T1CS_OP(hstem,		1, -1,	2, -1,	T1CS_BOTH)
+T1CS_OP(vstem,		3, -1,	2, -1,	T1CS_BOTH)
+T1CS_OP(vmoveto,	4, -1,	1, -1,	T1CS_BOTH)
+T1CS_OP(rlineto,	5, -1,	2, -1,	T1CS_BOTH)
+T1CS_OP(hlineto,	6, -1,	1, -1,	T1CS_BOTH)
+T1CS_OP(vlineto,	7, -1,	1, -1,	T1CS_BOTH)
+T1CS_OP(rrcurveto,	8, -1,	6, -1,	T1CS_BOTH)
+T1CS_OP(closepath,	9, -1,	0, NA,	T1CS_TYPE1)
+T1CS_OP(callsubr,	10, -1,	1, 1,	T1CS_BOTH)
+T1CS_OP(return,		11, -1,	0, 0,	T1CS_BOTH)
+T1CS_OP(escape,		12, -1,	0, 0,	T1CS_BOTH | T1CS_SPECIAL)
+T1CS_OP(hsbw,		13, -1,	2, NA,	T1CS_TYPE1)
+T1CS_OP(endchar,	14, -1,	0, -1,	T1CS_BOTH)
+T1CS_OP(blend,		16, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(hstemhm,	18, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(hintmask,	19, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(cntrmask,	20, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(rmoveto,	21, -1,	2, -1,	T1CS_BOTH)
+T1CS_OP(hmoveto,	22, -1,	1, -1,	T1CS_BOTH)
+T1CS_OP(vstemhm,	23, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(rcurveline,	24, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(rlinecurve,	25, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(vvcurveto,	26, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(hhcurveto,	27, -1,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(callgsubr,	29, -1,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(vhcurveto,	30, -1,	4, -1,	T1CS_BOTH)
+T1CS_OP(hvcurveto,	31, -1,	4, -1,	T1CS_BOTH)
+
+T1CS_OP(dotsection,	12, 0,	0, NA,	T1CS_TYPE1)
+T1CS_OP(vstem3,		12, 1,	6, NA,	T1CS_TYPE1)
+T1CS_OP(hstem3,		12, 2,	6, NA,	T1CS_TYPE1)
+T1CS_OP(and,		12, 3,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(or,		12, 4,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(not,		12, 5,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(seac,		12, 6,	5, NA,	T1CS_TYPE1)
+T1CS_OP(sbw,		12, 7,	4, NA,	T1CS_TYPE1)
+T1CS_OP(store,		12, 8,	NA, 4,	T1CS_TYPE2)
+T1CS_OP(abs,		12, 9,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(add,		12, 10,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(sub,		12, 11,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(div,		12, 12,	2, 2,	T1CS_BOTH)
+T1CS_OP(load,		12, 13,	NA, 3,	T1CS_TYPE2)
+T1CS_OP(neg,		12, 14,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(eq,		12, 15,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(callothersubr,	12, 16,	-1, NA,	T1CS_TYPE1)
+T1CS_OP(callother,	12, 16,	-1, NA,	T1CS_TYPE1 | T1CS_ALIAS)
+T1CS_OP(pop,		12, 17,	0, NA,	T1CS_TYPE1)
+T1CS_OP(drop,		12, 18,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(put,		12, 20,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(get,		12, 21,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(ifelse,		12, 22,	NA, 4,	T1CS_TYPE2)
+T1CS_OP(random,		12, 23,	NA, 0,	T1CS_TYPE2)
+T1CS_OP(mul,		12, 24,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(sqrt,		12, 26,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(dup,		12, 27,	NA, 1,	T1CS_TYPE2)
+T1CS_OP(exch,		12, 28,	NA, 2,	T1CS_TYPE2)
+T1CS_OP(index,		12, 29,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(roll,		12, 30,	NA, -1,	T1CS_TYPE2)
+T1CS_OP(setcurrentpoint, 12, 33, 2, NA,	T1CS_TYPE1)
+T1CS_OP(hflex,		12, 34,	NA, 7,	T1CS_TYPE2)
+T1CS_OP(flex,		12, 35,	NA, 13,	T1CS_TYPE2)
+T1CS_OP(hflex1,		12, 36,	NA, 9,	T1CS_TYPE2)
+T1CS_OP(flex1,		12, 37,	NA, 11,	T1CS_TYPE2)
+
+#undef T1CS_BOTH
+#undef NA
@@ -68,9 +68,17 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <assert.h>
+#if HAVE_PTHREADS
+# include <pthread.h>
+#endif
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 #include <lcdf/clp.h>
 #include "t1lib.h"
-#include "t1asmhelp.h"
+#include "t1scan.h"
+#include "t1cs.h"
+#include "t1records.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -84,200 +92,559 @@ static int unknown = 0;
 /* decryption stuff */
 static const uint32_t c1 = 52845;
 static const uint32_t c2 = 22719;
-static uint16_t cr_default = 4330;
 static uint16_t er_default = 55665;
 
 static int error_count = 0;
 
 
-/* Subroutine to output strings. */
+/* Buffers grow only through grow_buffer, which counts their sizes in
+   `memory_used'; fixed-size allocations are counted with charge_memory.
+   With --max-memory, going past `max_memory' is a fatal error. Jobs grow
+   buffers too, so the count is locked. */
+
+static unsigned long memory_used = 0;
+static unsigned long max_memory = 0;
+#if HAVE_PTHREADS
+static pthread_mutex_t memory_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 static void
-output(const char *string)
+charge_memory(unsigned long n)
 {
-    fprintf(ofp, "%s", string);
+  int over;
+#if HAVE_PTHREADS
+  pthread_mutex_lock(&memory_lock);
+#endif
+  memory_used += n;
+  over = (max_memory && memory_used > max_memory);
+#if HAVE_PTHREADS
+  pthread_mutex_unlock(&memory_lock);
+#endif
+  if (over)
+    fatal_error("memory limit of %lu bytes exceeded (try a larger --max-memory)",
+                max_memory);
+}
+
+static void *
+grow_buffer(void *buf, int *cap, int need)
+{
+  if (need > *cap) {
+    int new_cap = (*cap ? *cap : 1024);
+    while (need > new_cap)
+      new_cap *= 2;
+    charge_memory(new_cap - *cap);
+    if (!(buf = realloc(buf, new_cap)))
+      fatal_error("out of memory");
+    *cap = new_cap;
+  }
+  return buf;
 }
 
-/* Subroutine to neatly format output of charstring tokens.  If token = "\n",
-   then a newline is output.  If at start of line (start == 1), prefix token
-   with tab, otherwise a space. */
+
+/* Output goes through an outbuf, which collects text and writes it to `f'
+   in large pieces. An outbuf without a file just grows. `start' is 1 at
+   the beginning of a charstring line. */
+
+#define OUTBUF_SIZE 65536
+
+struct outbuf {
+  char *s;
+  int len;
+  int cap;
+  int start;
+  FILE *f;
+  long flushed;                 /* bytes already written to `f' */
+};
+
+static struct outbuf out;
+
+static FILE *map_file = 0;
+static void map_written(const char *s, int len);
 
 static void
-output_token(const char *token)
+outbuf_write(struct outbuf *ob, const char *s, int len)
 {
-    static int start = 1;
-    if (strcmp(token, "\n") == 0) {
-        fprintf(ofp, "\n");
-        start = 1;
-    } else {
-        fprintf(ofp, "%s%s", start ? "\t" : " ", token);
-        start = 0;
-    }
+  fwrite(s, 1, len, ob->f);
+  if (map_file && ob == &out)
+    map_written(s, len);
+  ob->flushed += len;
+}
+
+static void
+outbuf_flush(struct outbuf *ob)
+{
+  if (ob->f && ob->len) {
+    outbuf_write(ob, ob->s, ob->len);
+    ob->len = 0;
+  }
 }
 
-/* Subroutine to decrypt and ASCII-ify tokens in charstring data. The
-   charstring decryption machinery is fired up, skipping the first lenIV
-   bytes, and the decrypted tokens are expanded into human-readable form. */
+/* This function makes room for `n' more bytes and returns where they go. */
+
+static char *
+outbuf_reserve(struct outbuf *ob, int n)
+{
+  if (ob->len + n > ob->cap) {
+    outbuf_flush(ob);
+    if (ob->len + n > ob->cap)
+      ob->s = (char *) grow_buffer(ob->s, &ob->cap, ob->len + n);
+  }
+  return ob->s + ob->len;
+}
 
 static void
-decrypt_charstring(unsigned char *line, int len)
+output_bytes(struct outbuf *ob, const char *s, int len)
 {
-  int i;
-  int32_t val;
-  char buf[20];
+  if (len == 0)
+    return;
+  if (ob->f && len > ob->cap) {
+    outbuf_flush(ob);
+    outbuf_write(ob, s, len);
+  } else {
+    memcpy(outbuf_reserve(ob, len), s, len);
+    ob->len += len;
+  }
+}
 
-  /* decrypt charstring */
-  if (lenIV >= 0) {
-    /* only decrypt if lenIV >= 0 -- negative lenIV means unencrypted
-       charstring. Thanks to Tom Kacvinsky <tjk@ams.org> */
-    uint16_t cr = cr_default;
-    byte plain;
-    for (i = 0; i < len; i++) {
-      byte cipher = line[i];
-      plain = (byte)(cipher ^ (cr >> 8));
-      cr = (uint16_t)((cipher + cr) * c1 + c2);
-      line[i] = plain;
-    }
-    line += lenIV;
-    len -= lenIV;
+/* Subroutines to neatly format output of charstring tokens. A token at the
+   start of a line is prefixed with a tab, otherwise with a space. */
+
+static void
+output_token(struct outbuf *ob, const char *token, int len)
+{
+  char *p = outbuf_reserve(ob, len + 1);
+  *p = (ob->start ? '\t' : ' ');
+  memcpy(p + 1, token, len);
+  ob->len += len + 1;
+  ob->start = 0;
+}
+
+static void
+output_newline(struct outbuf *ob)
+{
+  *outbuf_reserve(ob, 1) = '\n';
+  ob->len++;
+  ob->start = 1;
+}
+
+/* This function outputs a number as a token. Digits are produced two at a
+   time from a table, from the right. */
+
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+
+static char *
+format_int(char *end, int32_t val)
+{
+  char *p = end;
+  uint32_t u = (val < 0 ? -(uint32_t) val : (uint32_t) val);
+
+  while (u >= 100) {
+    uint32_t r = u % 100;
+    u /= 100;
+    p -= 2;
+    memcpy(p, digit_pairs + 2 * r, 2);
+  }
+  if (u >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2 * u, 2);
+  } else
+    *--p = (char) ('0' + u);
+  if (val < 0)
+    *--p = '-';
+  return p;
+}
+
+static void
+output_int_token(struct outbuf *ob, int32_t val)
+{
+  char buf[12];
+  char *p = format_int(buf + sizeof(buf), val);
+  output_token(ob, p, buf + sizeof(buf) - p);
+}
+
+/* A job disassembles a run of charstrings. With --jobs, each thread runs
+   its own job and formats into the job's outbuf; otherwise job 0 formats
+   straight into `out'. Decoding state and error counts are per job. */
+
+struct disasm_job {
+  struct outbuf ob;
+  struct t1cs_ir ir;
+  void *ir_arena;
+  int ir_arena_cap;
+  int ir_arena_len;
+  int first;                    /* pending charstrings first..last-1 */
+  int last;
+  int unknown;
+  int errors;                   /* charstrings too short */
+};
+
+static struct disasm_job *jobs;
+static int njobs = 1;
+
+/* Subroutine to output the operands args[a] through args[end - 1]. */
+
+static void
+disasm_args(struct outbuf *ob, const struct t1cs_ir *ir, int a, int end)
+{
+  for (; a < end; a++)
+    output_int_token(ob, ir->args[a]);
+}
+
+/* This function decodes a decrypted charstring into the job's IR. The
+   first lenIV bytes are skipped. */
+
+static void
+decode_charstring(struct disasm_job *job, unsigned char *line, int len,
+                  int cs_lenIV)
+{
+  struct t1cs_ir *ir = &job->ir;
+
+  /* only skip if lenIV >= 0 -- negative lenIV means unencrypted
+     charstring. Thanks to Tom Kacvinsky <tjk@ams.org> */
+  if (cs_lenIV >= 0) {
+    line += cs_lenIV;
+    len -= cs_lenIV;
   }
 
+  if (!job->ir_arena || len > job->ir_arena_len) {
+    job->ir_arena_len = (len > 256 ? len : 256);
+    job->ir_arena = grow_buffer(job->ir_arena, &job->ir_arena_cap,
+                                (int) T1CS_ARENA_SIZE(job->ir_arena_len));
+  }
+  t1cs_ir_init(ir, job->ir_arena, job->ir_arena_len);
+  if (len >= 0)
+    t1cs_decode_charstring(ir, line, len);
+  else
+    ir->truncated = 1;
+
+  if (ir->truncated)
+    job->errors++;
+}
+
+/* This function returns the name of an operator, or a made-up name like
+   `UNKNOWN_15', which it counts. */
+
+static const char *
+op_name(struct disasm_job *job, int opcode, char *buf, int *len)
+{
+  const struct t1cs_op *op = t1cs_decode(opcode);
+  if (op) {
+    *len = op->namelen;
+    return op->name;
+  }
+  if (opcode >= 256)
+    sprintf(buf, "escape_%d", opcode - 256);
+  else
+    sprintf(buf, "UNKNOWN_%d", opcode);
+  job->unknown++;
+  *len = strlen(buf);
+  return buf;
+}
+
+
+/* Output formats. The text format is the human-readable pseudo-PostScript
+   that t1asm reads. The JSON and binary formats hold the same text, minus
+   the charstrings, in text records, and each charstring as a record of
+   operators and operands; see t1records.h.
+
+   Text is output only by the main thread. Charstring records may be
+   formatted by any job, and are output after calling text_end, which
+   finishes the current text record. */
+
+struct disasm_format {
+  const char *name;
+  const char *separator;        /* between records */
+  void (*begin)(void);
+  void (*text)(const char *s, int len);
+  void (*text_end)(void);
+  void (*charstring)(struct disasm_job *, struct outbuf *,
+                     int subr, const char *name, int namelen);
+  void (*end)(void);
+};
+
+static const struct disasm_format *format;
+static int nrecords = 0;
+static struct outbuf text_record;
+
+static void
+record_start(void)
+{
+  if (format->separator && nrecords++)
+    output_bytes(&out, format->separator, strlen(format->separator));
+}
+
+static void
+record_text(const char *s, int len)
+{
+  output_bytes(&text_record, s, len);
+}
+
+static void
+output_text(const char *s, int len)
+{
+  format->text(s, len);
+}
+
+
+/* Text format. Charstring tokens are ASCII-ified. */
+
+static void
+text_text(const char *s, int len)
+{
+  output_bytes(&out, s, len);
+}
+
+static void
+text_charstring(struct disasm_job *job, struct outbuf *ob,
+                int subr, const char *name, int namelen)
+{
+  struct t1cs_ir *ir = &job->ir;
+  int i, len;
+  const char *s;
+  char buf[20];
+  (void) subr, (void) name, (void) namelen;
+
+  output_bytes(ob, " {\n", 3);
+
   /* handle each charstring command */
-  for (i = 0; i < len; i++) {
-    byte b = line[i];
+  ob->start = 1;
+  for (i = 0; i < ir->nops; i++) {
+    disasm_args(ob, ir, ir->argstart[i], ir->argstart[i + 1]);
+    s = op_name(job, ir->ops[i], buf, &len);
+    output_token(ob, s, len);
+    output_newline(ob);
+  }
+  disasm_args(ob, ir, ir->argstart[ir->nops], ir->nargs);
+
+  if (ir->truncated)
+    output_bytes(ob, "\terror\n", 7);
+  output_bytes(ob, "\t}", 2);
+}
 
-    if (b >= 32) {
-      if (b >= 32 && b <= 246)
-        val = b - 139;
-      else if (b >= 247 && b <= 250) {
-        i++;
-        val = (b - 247)*256 + 108 + line[i];
-      } else if (b >= 251 && b <= 254) {
-        i++;
-        val = -(b - 251)*256 - 108 - line[i];
-      } else {
-        uint32_t uval;
-        uval =  (uint32_t) line[i+1] << 24;
-        uval |= (uint32_t) line[i+2] << 16;
-        uval |= (uint32_t) line[i+3] <<  8;
-        uval |= (uint32_t) line[i+4] <<  0;
-        /* in case an int32 is larger than four bytes---sign extend */
-#if INT_MAX > 0x7FFFFFFFUL
-        if (uval & 0x80000000U)
-          uval |= ~0x7FFFFFFFU;
-#endif
-        val = (int32_t) uval;
-        i += 4;
-      }
-      sprintf(buf, "%d", val);
-      output_token(buf);
 
+/* JSON format. The output is an array of objects, one per line:
+     {"text": "..."}
+     {"subr": 5, "charstring": [[8, 111, "vstem"], ["return"]]}
+     {"glyph": "A", "charstring": [...]}
+   Each charstring element holds an operator's operands followed by its
+   name; operands left over at the end form a last element without a name.
+   Control characters and bytes above 126 are written as \u00XX escapes. */
+
+static void
+json_string(struct outbuf *ob, const char *s, int len)
+{
+  static const char *hexchar = "0123456789ABCDEF";
+  const unsigned char *p = (const unsigned char *) s, *end = p + len;
+  char *q = outbuf_reserve(ob, 1);
+  *q = '\"';
+  ob->len++;
+  for (; p < end; p++) {
+    q = outbuf_reserve(ob, 6);
+    if (*p == '\"' || *p == '\\') {
+      q[0] = '\\';
+      q[1] = *p;
+      ob->len += 2;
+    } else if (*p == '\n') {
+      memcpy(q, "\\n", 2);
+      ob->len += 2;
+    } else if (*p == '\r') {
+      memcpy(q, "\\r", 2);
+      ob->len += 2;
+    } else if (*p == '\t') {
+      memcpy(q, "\\t", 2);
+      ob->len += 2;
+    } else if (*p < 32 || *p >= 127) {
+      memcpy(q, "\\u00", 4);
+      q[4] = hexchar[*p >> 4];
+      q[5] = hexchar[*p & 15];
+      ob->len += 6;
     } else {
-      switch (b) {
-      case 0: output_token("error"); break;             /* special */
-      case 1: output_token("hstem"); break;
-      case 3: output_token("vstem"); break;
-      case 4: output_token("vmoveto"); break;
-      case 5: output_token("rlineto"); break;
-      case 6: output_token("hlineto"); break;
-      case 7: output_token("vlineto"); break;
-      case 8: output_token("rrcurveto"); break;
-      case 9: output_token("closepath"); break;         /* Type 1 ONLY */
-      case 10: output_token("callsubr"); break;
-      case 11: output_token("return"); break;
-      case 13: output_token("hsbw"); break;             /* Type 1 ONLY */
-      case 14: output_token("endchar"); break;
-      case 16: output_token("blend"); break;            /* Type 2 */
-      case 18: output_token("hstemhm"); break;          /* Type 2 */
-      case 19: output_token("hintmask"); break;         /* Type 2 */
-      case 20: output_token("cntrmask"); break;         /* Type 2 */
-      case 21: output_token("rmoveto"); break;
-      case 22: output_token("hmoveto"); break;
-      case 23: output_token("vstemhm"); break;          /* Type 2 */
-      case 24: output_token("rcurveline"); break;       /* Type 2 */
-      case 25: output_token("rlinecurve"); break;       /* Type 2 */
-      case 26: output_token("vvcurveto"); break;        /* Type 2 */
-      case 27: output_token("hhcurveto"); break;        /* Type 2 */
-      case 28: {                /* Type 2 */
-        /* short integer */
-        val =  (line[i+1] & 0xff) << 8;
-        val |= (line[i+2] & 0xff);
-        i += 2;
-        if (val & 0x8000)
-          val |= ~0x7FFF;
-        sprintf(buf, "%d", val);
-        output_token(buf);
-      }
-      case 29: output_token("callgsubr"); break;        /* Type 2 */
-      case 30: output_token("vhcurveto"); break;
-      case 31: output_token("hvcurveto"); break;
-      case 12:
-        i++;
-        b = line[i];
-        switch (b) {
-        case 0: output_token("dotsection"); break;      /* Type 1 ONLY */
-        case 1: output_token("vstem3"); break;          /* Type 1 ONLY */
-        case 2: output_token("hstem3"); break;          /* Type 1 ONLY */
-        case 3: output_token("and"); break;             /* Type 2 */
-        case 4: output_token("or"); break;              /* Type 2 */
-        case 5: output_token("not"); break;             /* Type 2 */
-        case 6: output_token("seac"); break;            /* Type 1 ONLY */
-        case 7: output_token("sbw"); break;             /* Type 1 ONLY */
-        case 8: output_token("store"); break;           /* Type 2 */
-        case 9: output_token("abs"); break;             /* Type 2 */
-        case 10: output_token("add"); break;            /* Type 2 */
-        case 11: output_token("sub"); break;            /* Type 2 */
-        case 12: output_token("div"); break;
-        case 13: output_token("load"); break;           /* Type 2 */
-        case 14: output_token("neg"); break;            /* Type 2 */
-        case 15: output_token("eq"); break;             /* Type 2 */
-        case 16: output_token("callothersubr"); break;  /* Type 1 ONLY */
-        case 17: output_token("pop"); break;            /* Type 1 ONLY */
-        case 18: output_token("drop"); break;           /* Type 2 */
-        case 20: output_token("put"); break;            /* Type 2 */
-        case 21: output_token("get"); break;            /* Type 2 */
-        case 22: output_token("ifelse"); break;         /* Type 2 */
-        case 23: output_token("random"); break;         /* Type 2 */
-        case 24: output_token("mul"); break;            /* Type 2 */
-        case 26: output_token("sqrt"); break;           /* Type 2 */
-        case 27: output_token("dup"); break;            /* Type 2 */
-        case 28: output_token("exch"); break;           /* Type 2 */
-        case 29: output_token("index"); break;          /* Type 2 */
-        case 30: output_token("roll"); break;           /* Type 2 */
-        case 33: output_token("setcurrentpoint"); break;/* Type 1 ONLY */
-        case 34: output_token("hflex"); break;          /* Type 2 */
-        case 35: output_token("flex"); break;           /* Type 2 */
-        case 36: output_token("hflex1"); break;         /* Type 2 */
-        case 37: output_token("flex1"); break;          /* Type 2 */
-        default:
-          sprintf(buf, "escape_%d", b);
-          unknown++;
-          output_token(buf);
-          break;
-        }
-        break;
-      default:
-       sprintf(buf, "UNKNOWN_%d", b);
-       unknown++;
-       output_token(buf);
-       break;
-      }
-      output_token("\n");
+      *q = *p;
+      ob->len++;
     }
   }
-  if (i > len) {
-    output("\terror\n");
-    error("disassembly error: charstring too short");
+  *outbuf_reserve(ob, 1) = '\"';
+  ob->len++;
+}
+
+static void
+json_int(struct outbuf *ob, int32_t val)
+{
+  char buf[12];
+  char *p = format_int(buf + sizeof(buf), val);
+  output_bytes(ob, p, buf + sizeof(buf) - p);
+}
+
+static void
+json_begin(void)
+{
+  output_bytes(&out, "[\n", 2);
+}
+
+static void
+json_text_end(void)
+{
+  if (text_record.len) {
+    record_start();
+    output_bytes(&out, "{\"text\": ", 9);
+    json_string(&out, text_record.s, text_record.len);
+    output_bytes(&out, "}", 1);
+    text_record.len = 0;
+  }
+}
+
+static void
+json_args(struct outbuf *ob, const struct t1cs_ir *ir, int a, int end)
+{
+  for (; a < end; a++) {
+    json_int(ob, ir->args[a]);
+    output_bytes(ob, ", ", 2);
   }
 }
 
+static void
+json_charstring(struct disasm_job *job, struct outbuf *ob,
+                int subr, const char *name, int namelen)
+{
+  struct t1cs_ir *ir = &job->ir;
+  int i, len;
+  const char *s;
+  char buf[20];
+
+  if (subr >= 0) {
+    output_bytes(ob, "{\"subr\": ", 9);
+    json_int(ob, subr);
+    output_bytes(ob, ", ", 2);
+  } else if (name) {
+    output_bytes(ob, "{\"glyph\": ", 10);
+    json_string(ob, name, namelen);
+    output_bytes(ob, ", ", 2);
+  } else
+    output_bytes(ob, "{", 1);
+
+  output_bytes(ob, "\"charstring\": [", 15);
+  for (i = 0; i < ir->nops; i++) {
+    output_bytes(ob, (i ? ", [" : "["), (i ? 3 : 1));
+    json_args(ob, ir, ir->argstart[i], ir->argstart[i + 1]);
+    s = op_name(job, ir->ops[i], buf, &len);
+    json_string(ob, s, len);
+    output_bytes(ob, "]", 1);
+  }
+  if (ir->argstart[ir->nops] < ir->nargs) {
+    output_bytes(ob, (i ? ", [" : "["), (i ? 3 : 1));
+    json_args(ob, ir, ir->argstart[ir->nops], ir->nargs);
+    ob->len -= 2;               /* remove trailing ", " */
+    output_bytes(ob, "]", 1);
+  }
+  output_bytes(ob, "]", 1);
+
+  if (ir->truncated)
+    output_bytes(ob, ", \"truncated\": true", 19);
+  output_bytes(ob, "}", 1);
+}
+
+static void
+json_end(void)
+{
+  output_bytes(&out, "\n]\n", 3);
+}
+
+
+/* Binary format, described in t1records.h. */
+
+static unsigned char *
+put_int(unsigned char *p, uint32_t val, int nbytes)
+{
+  while (nbytes-- > 0)
+    *p++ = (unsigned char) (val >> (8 * nbytes));
+  return p;
+}
+
+static void
+binary_record(struct outbuf *ob, int type, int len)
+{
+  unsigned char *p = (unsigned char *) outbuf_reserve(ob, T1R_HEADER_LEN);
+  p[0] = (unsigned char) type;
+  put_int(p + 1, len, 4);
+  ob->len += T1R_HEADER_LEN;
+}
+
+static void
+binary_begin(void)
+{
+  output_bytes(&out, T1R_MAGIC, T1R_MAGIC_LEN);
+}
+
+static void
+binary_text_end(void)
+{
+  if (text_record.len) {
+    binary_record(&out, T1R_TEXT, text_record.len);
+    output_bytes(&out, text_record.s, text_record.len);
+    text_record.len = 0;
+  }
+}
+
+static void
+binary_charstring(struct disasm_job *job, struct outbuf *ob,
+                  int subr, const char *name, int namelen)
+{
+  struct t1cs_ir *ir = &job->ir;
+  int len = T1R_CHARSTRING_LEN(namelen, ir->nops, ir->nargs);
+  unsigned char *p;
+  int i;
+
+  binary_record(ob, T1R_CHARSTRING, len);
+  p = (unsigned char *) outbuf_reserve(ob, len);
+  p = put_int(p, subr, 4);
+  p = put_int(p, namelen, 2);
+  if (namelen)
+    memcpy(p, name, namelen);
+  p += namelen;
+  *p++ = (ir->truncated ? T1R_TRUNCATED : 0);
+  p = put_int(p, ir->nops, 4);
+  p = put_int(p, ir->nargs, 4);
+  for (i = 0; i <= ir->nops; i++)
+    p = put_int(p, ir->argstart[i], 4);
+  for (i = 0; i < ir->nops; i++)
+    p = put_int(p, ir->ops[i], 2);
+  for (i = 0; i < ir->nargs; i++)
+    p = put_int(p, ir->args[i], 4);
+  ob->len += len;
+}
+
+static void
+binary_end(void)
+{
+  binary_record(&out, T1R_END, 0);
+}
+
+
+static const struct disasm_format formats[] = {
+  { "text", 0, 0, text_text, 0, text_charstring, 0 },
+  { "json", ",\n", json_begin, record_text, json_text_end, json_charstring,
+    json_end },
+  { "binary", 0, binary_begin, record_text, binary_text_end,
+    binary_charstring, binary_end }
+};
+
 
 /* Disassembly font_reader functions */
 
 static int in_eexec = 0;
+
+/* scans the eexec text for lenIV, the charstring start command, and the
+   `currentfile closefile' that ends decryption */
+static struct t1scan scan;
+
 static unsigned char *save = 0;
 static int save_len = 0;
 static int save_cap = 0;
+static long save_offset;        /* position of eexec text in save */
+static long eexec_pos;          /* eexec bytes decrypted so far */
 
 static void
 append_save(const unsigned char *line, int len)
@@ -287,60 +654,492 @@ append_save(const unsigned char *line, int len)
     save_len = len;
     return;
   }
-  if (save_len + len >= save_cap) {
-    unsigned char *new_save;
-    if (!save_cap) save_cap = 1024;
-    while (save_len + len >= save_cap) save_cap *= 2;
-    new_save = (unsigned char *)malloc(save_cap);
-    if (!new_save)
+  /* leave room for the null disasm_output_ascii adds */
+  save = (unsigned char *) grow_buffer(save, &save_cap, save_len + len + 1);
+  memmove(save + save_len, line, len);
+  save_len += len;
+}
+
+
+/* Charstrings are not disassembled as soon as they are found. Instead, the
+   text around them and their encrypted bytes are queued; a full queue is
+   split into one run per job, each run is decrypted in one go by
+   decrypt_charstrings() and disassembled, and the results are printed in
+   order. */
+
+#define PENDING_BATCH 256       /* per job */
+
+struct pending_charstring {
+  int text_pos;                 /* charstring goes here in pending_text */
+  int data_pos;                 /* encrypted bytes start here in pending_data */
+  int len;
+  int lenIV;
+  long eexec_pos;               /* offset of encrypted bytes in eexec data */
+  int subr;                     /* Subr number, or -1 */
+  int name_pos;                 /* glyph name is here in pending_names */
+  int name_len;
+  int out_pos;                  /* disassembly is here in its job's outbuf */
+  int out_len;
+};
+
+static struct pending_charstring *pending = 0;
+static int npending = 0;
+static int pending_cap = 0;
+static int pending_limit = 0;   /* flush early past this many data bytes */
+static char *pending_text = 0;
+static int pending_text_len = 0;
+static int pending_text_cap = 0;
+static unsigned char *pending_data = 0;
+static int pending_data_len = 0;
+static int pending_data_cap = 0;
+static char *pending_names = 0;
+static int pending_names_len = 0;
+static int pending_names_cap = 0;
+static unsigned char **pending_cs = 0; /* arguments to decrypt_charstrings */
+static int *pending_cs_len = 0;
+
+static void
+decrypt_pending(int first, int last)
+{
+  int i, n = first;
+  for (i = first; i < last; i++)
+    if (pending[i].lenIV >= 0) {
+      pending_cs[n] = pending_data + pending[i].data_pos;
+      pending_cs_len[n] = pending[i].len;
+      n++;
+    }
+  decrypt_charstrings(pending_cs + first, pending_cs_len + first, n - first);
+}
+
+static void
+disasm_pending(struct disasm_job *job, struct outbuf *ob, int i)
+{
+  struct pending_charstring *pcs = &pending[i];
+  decode_charstring(job, pending_data + pcs->data_pos, pcs->len, pcs->lenIV);
+  format->charstring(job, ob, pcs->subr,
+                     (pcs->name_len ? pending_names + pcs->name_pos : 0),
+                     pcs->name_len);
+}
+
+static void
+run_job(struct disasm_job *job)
+{
+  int i;
+  decrypt_pending(job->first, job->last);
+  job->ob.len = 0;
+  for (i = job->first; i < job->last; i++) {
+    pending[i].out_pos = job->ob.len;
+    disasm_pending(job, &job->ob, i);
+    pending[i].out_len = job->ob.len - pending[i].out_pos;
+  }
+}
+
+
+/* Worker threads. Each waits for a new generation of jobs, runs its own,
+   and reports back; the main thread runs job 0. */
+
+#if HAVE_PTHREADS
+static pthread_t *threads;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobs_finish = PTHREAD_COND_INITIALIZER;
+static int jobs_generation = 0;
+static int jobs_running = 0;
+static int jobs_exit = 0;
+
+static void *
+worker(void *arg)
+{
+  struct disasm_job *job = (struct disasm_job *) arg;
+  int generation = 0;
+
+  pthread_mutex_lock(&jobs_lock);
+  while (1) {
+    while (jobs_generation == generation && !jobs_exit)
+      pthread_cond_wait(&jobs_start, &jobs_lock);
+    if (jobs_exit)
+      break;
+    generation = jobs_generation;
+    pthread_mutex_unlock(&jobs_lock);
+
+    run_job(job);
+
+    pthread_mutex_lock(&jobs_lock);
+    if (--jobs_running == 0)
+      pthread_cond_signal(&jobs_finish);
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  return 0;
+}
+#endif
+
+static void
+run_jobs(void)
+{
+#if HAVE_PTHREADS
+  pthread_mutex_lock(&jobs_lock);
+  jobs_generation++;
+  jobs_running = njobs - 1;
+  pthread_cond_broadcast(&jobs_start);
+  pthread_mutex_unlock(&jobs_lock);
+
+  run_job(&jobs[0]);
+
+  pthread_mutex_lock(&jobs_lock);
+  while (jobs_running > 0)
+    pthread_cond_wait(&jobs_finish, &jobs_lock);
+  pthread_mutex_unlock(&jobs_lock);
+#else
+  int j;
+  for (j = 0; j < njobs; j++)
+    run_job(&jobs[j]);
+#endif
+}
+
+static void
+start_jobs(void)
+{
+  int j;
+
+  /* initialize shared tables before any thread uses them */
+  t1cs_init();
+  (void) kernel_variant();
+
+  if (!(jobs = (struct disasm_job *) calloc(njobs, sizeof(*jobs))))
+    fatal_error("out of memory");
+  charge_memory(njobs * sizeof(*jobs));
+  pending_cap = PENDING_BATCH * njobs;
+  pending = (struct pending_charstring *)
+    malloc(pending_cap * sizeof(struct pending_charstring));
+  pending_cs = (unsigned char **) malloc(pending_cap * sizeof(unsigned char *));
+  pending_cs_len = (int *) malloc(pending_cap * sizeof(int));
+  if (!pending || !pending_cs || !pending_cs_len)
+    fatal_error("out of memory");
+  charge_memory(pending_cap * (sizeof(struct pending_charstring)
+                               + sizeof(unsigned char *) + sizeof(int)));
+
+  /* Under a memory cap, keep a batch small enough that its disassembly
+     fits too. Text is at most about 16 bytes per charstring byte, and jobs
+     hold all of theirs before it is printed. */
+  if (max_memory)
+    pending_limit = (int) (max_memory / (njobs > 1 ? 64 : 8));
+
+#if HAVE_PTHREADS
+  if (njobs > 1) {
+    if (!(threads = (pthread_t *) malloc((njobs - 1) * sizeof(pthread_t))))
       fatal_error("out of memory");
-    memcpy(new_save, save, save_len);
-    free(save);
-    save = new_save;
+    charge_memory((njobs - 1) * sizeof(pthread_t));
+    for (j = 1; j < njobs; j++)
+      if (pthread_create(&threads[j - 1], 0, worker, &jobs[j]) != 0)
+        fatal_error("can't create thread: %s", strerror(errno));
   }
-  memcpy(save + save_len, line, len);
-  save_len += len;
+#else
+  (void) j;
+#endif
 }
 
+static void
+stop_jobs(void)
+{
+#if HAVE_PTHREADS
+  int j;
+  if (njobs > 1) {
+    pthread_mutex_lock(&jobs_lock);
+    jobs_exit = 1;
+    pthread_cond_broadcast(&jobs_start);
+    pthread_mutex_unlock(&jobs_lock);
+    for (j = 1; j < njobs; j++)
+      pthread_join(threads[j - 1], 0);
+  }
+#endif
+}
+
+/* With --source-map, a line is written to `map_file' for each charstring
+   printed, giving its Subr number or glyph name, its lines and byte
+   offsets in the output, and the offset and length of its encrypted bytes
+   in the eexec section. Output lines are counted as the output is
+   written, so an entry is finished once its last byte is written. */
+
+struct map_entry {
+  int subr;
+  int name_pos;                 /* in map_names; -1 if no name */
+  long eexec_pos;
+  int eexec_len;
+  long out_start;
+  long out_end;                 /* LONG_MAX until known */
+  long first_line;              /* 0 until known */
+};
+
+static struct map_entry *map_entries = 0;
+static int nmap_entries = 0;
+static int map_entries_cap = 0;  /* in bytes */
+static char *map_names = 0;     /* null-terminated glyph names */
+static int map_names_len = 0;
+static int map_names_cap = 0;
+static int map_first = 0;       /* first unfinished entry */
+static long map_pos = 0;        /* output bytes counted */
+static long map_line = 1;       /* line number at map_pos */
 
-static unsigned char*
-check_eexec_charstrings_begin(unsigned char* line, int line_len)
+/* This function counts lines up to output offset `pos'. `s' holds the
+   output starting at offset `s_pos'. */
+
+static void
+map_advance(const char *s, long s_pos, long pos)
 {
-    unsigned char* line_end = line + line_len;
-    line = memmem(line, line_len, "/CharStrings ", 13);
-    if (!line)
-        return 0;
-    line += 13;
-    while (line < line_end && isspace(*line))
-        ++line;
-    if (line == line_end || !isdigit(*line))
-        return 0;
-    while (line < line_end && isdigit(*line))
-        ++line;
-    if (line == line_end || !isspace(*line))
-        return 0;
-    while (line < line_end && isspace(*line))
-        ++line;
-    if (line_end - line < 14 || memcmp(line, "dict dup begin", 14) != 0)
-        return 0;
-    line += 14;
-    while (line < line_end && isspace(*line))
-        ++line;
-    if (line == line_end || *line != '/')
-        return 0;
-    return line;
+  const char *p = s + (map_pos - s_pos), *end = s + (pos - s_pos);
+  while (p < end && (p = (const char *) memchr(p, '\n', end - p))) {
+    map_line++;
+    p++;
+  }
+  map_pos = pos;
+}
+
+static void
+map_written(const char *s, int len)
+{
+  long s_pos = map_pos, end = map_pos + len;
+
+  for (; map_first < nmap_entries; map_first++) {
+    struct map_entry *e = &map_entries[map_first];
+    if (!e->first_line) {
+      if (e->out_start >= end)
+        break;
+      map_advance(s, s_pos, e->out_start);
+      e->first_line = map_line;
+    }
+    if (e->out_end > end)
+      break;
+    map_advance(s, s_pos, e->out_end - 1);
+    if (e->subr >= 0)
+      fprintf(map_file, "subr\t%d", e->subr);
+    else
+      fprintf(map_file, "glyph\t%s",
+              (e->name_pos >= 0 ? map_names + e->name_pos : ""));
+    fprintf(map_file, "\t%ld\t%ld\t%ld\t%ld\t%ld\t%d\n", e->first_line,
+            map_line, e->out_start, e->out_end - e->out_start,
+            e->eexec_pos, e->eexec_len);
+  }
+  map_advance(s, s_pos, end);
+
+  if (map_first == nmap_entries)
+    map_first = nmap_entries = map_names_len = 0;
+}
+
+/* This function adds a map entry for pending charstring `i', which starts
+   at the current output position. */
+
+static struct map_entry *
+map_add(int i)
+{
+  struct pending_charstring *pcs = &pending[i];
+  struct map_entry *e;
+
+  map_entries = (struct map_entry *)
+    grow_buffer(map_entries, &map_entries_cap,
+                (nmap_entries + 1) * sizeof(struct map_entry));
+  e = &map_entries[nmap_entries++];
+  e->subr = pcs->subr;
+  e->name_pos = -1;
+  if (pcs->name_len) {
+    map_names = (char *) grow_buffer(map_names, &map_names_cap,
+                                     map_names_len + pcs->name_len + 1);
+    e->name_pos = map_names_len;
+    memcpy(map_names + map_names_len, pending_names + pcs->name_pos,
+           pcs->name_len);
+    map_names_len += pcs->name_len;
+    map_names[map_names_len++] = 0;
+  }
+  e->eexec_pos = pcs->eexec_pos;
+  e->eexec_len = pcs->len;
+  e->out_start = out.flushed + out.len;
+  e->out_end = LONG_MAX;
+  e->first_line = 0;
+  return e;
+}
+
+/* This function finishes the text before a charstring record. */
+
+static void
+charstring_output_start(void)
+{
+  if (format->text_end)
+    format->text_end();
+  record_start();
+}
+
+static void
+flush_pending(void)
+{
+  int i, j, text_pos = 0;
+  struct map_entry *e;
+
+  if (njobs == 1) {
+    /* serial: format straight into the output */
+    decrypt_pending(0, npending);
+    for (i = 0; i < npending; i++) {
+      output_text(pending_text + text_pos, pending[i].text_pos - text_pos);
+      charstring_output_start();
+      e = (map_file ? map_add(i) : 0);
+      disasm_pending(&jobs[0], &out, i);
+      if (e)
+        e->out_end = out.flushed + out.len;
+      text_pos = pending[i].text_pos;
+    }
+
+  } else {
+    /* split the queue into runs of about the same number of bytes */
+    for (i = j = 0; j < njobs; j++) {
+      long limit = (long) pending_data_len * (j + 1) / njobs;
+      jobs[j].first = i;
+      while (i < npending && (j == njobs - 1 || pending[i].data_pos < limit))
+        i++;
+      jobs[j].last = i;
+    }
+
+    run_jobs();
+
+    for (j = 0; j < njobs; j++)
+      for (i = jobs[j].first; i < jobs[j].last; i++) {
+        output_text(pending_text + text_pos, pending[i].text_pos - text_pos);
+        charstring_output_start();
+        e = (map_file ? map_add(i) : 0);
+        output_bytes(&out, jobs[j].ob.s + pending[i].out_pos,
+                     pending[i].out_len);
+        if (e)
+          e->out_end = out.flushed + out.len;
+        text_pos = pending[i].text_pos;
+      }
+  }
+  output_text(pending_text + text_pos, pending_text_len - text_pos);
+
+  for (j = 0; j < njobs; j++) {
+    unknown += jobs[j].unknown;
+    jobs[j].unknown = 0;
+    for (; jobs[j].errors > 0; jobs[j].errors--)
+      error("disassembly error: charstring too short");
+  }
+
+  npending = pending_text_len = pending_data_len = pending_names_len = 0;
 }
 
+static void
+pending_output(const unsigned char *text, int len)
+{
+  if (!npending)
+    output_text((const char *) text, len);
+  else {
+    pending_text = (char *) grow_buffer(pending_text, &pending_text_cap,
+                                        pending_text_len + len);
+    memcpy(pending_text + pending_text_len, text, len);
+    pending_text_len += len;
+  }
+}
 
-/* returns 1 if next \n should be deleted */
+static void
+pending_charstring_add(const unsigned char *data, int len, long eexec_pos,
+                       int subr, const unsigned char *name, int name_len)
+{
+  struct pending_charstring *pcs = &pending[npending];
+  pending_data = (unsigned char *) grow_buffer(pending_data, &pending_data_cap,
+                                               pending_data_len + len);
+  memcpy(pending_data + pending_data_len, data, len);
+  pending_names = (char *) grow_buffer(pending_names, &pending_names_cap,
+                                       pending_names_len + name_len);
+  if (name_len)
+    memcpy(pending_names + pending_names_len, name, name_len);
+  pcs->text_pos = pending_text_len;
+  pcs->data_pos = pending_data_len;
+  pcs->len = len;
+  pcs->lenIV = scan.lenIV;
+  pcs->eexec_pos = eexec_pos;
+  pcs->subr = subr;
+  pcs->name_pos = pending_names_len;
+  pcs->name_len = name_len;
+  pending_data_len += len;
+  pending_names_len += name_len;
+  if (++npending == pending_cap
+      || (pending_limit && pending_data_len > pending_limit))
+    flush_pending();
+}
+
+
+/* With --glyph or --subrs, only the selected charstrings are queued and
+   printed; other charstrings and all other text are skipped. */
+
+static int selecting = 0;
+static const char **select_glyphs = 0;
+static char *select_glyph_found = 0;
+static int nselect_glyphs = 0;
+static int select_glyphs_cap = 0;
+static int *select_subrs = 0;   /* pairs of first, last Subr numbers */
+static int nselect_subrs = 0;
+static int select_subrs_cap = 0;
+
+static int CDECL
+glyph_sort(const void *a, const void *b)
+{
+  return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+static int CDECL
+glyph_compare(const void *key, const void *item)
+{
+  return strcmp((const char *) key, *(const char * const *) item);
+}
+
+/* This function returns 1 if the charstring for `glyph' (null if none) or
+   Subr `subr' (-1 if none) is selected. */
 
 static int
-eexec_line(unsigned char *line, int line_len)
+charstring_selected(const unsigned char *glyph, int glyph_len, int subr)
 {
+  int i;
+  char name[T1SCAN_TOKLEN + 1];
+  const char **found;
+
+  if (subr >= 0) {
+    for (i = 0; i < nselect_subrs; i += 2)
+      if (subr >= select_subrs[i] && subr <= select_subrs[i + 1])
+        return 1;
+    return 0;
+  }
+
+  if (!glyph || glyph_len > T1SCAN_TOKLEN)
+    return 0;
+  memcpy(name, glyph, glyph_len);
+  name[glyph_len] = 0;
+  found = (const char **) bsearch(name, select_glyphs, nselect_glyphs,
+                                  sizeof(const char *), glyph_compare);
+  if (found)
+    select_glyph_found[found - select_glyphs] = 1;
+  return found != 0;
+}
+
+/* With --no-charstrings, charstrings are neither decrypted nor
+   disassembled. Each is replaced by a placeholder giving its length. With
+   --omit-charstrings, their whole definitions are left out. */
+
+#define CHARSTRINGS_ALL         0
+#define CHARSTRINGS_PLACEHOLDER 1
+#define CHARSTRINGS_OMIT        2
+
+static int charstrings_mode = CHARSTRINGS_ALL;
+
+/* `offset' is the line's position in the eexec data. Returns 1 if next \n
+   should be deleted. */
+
+static int
+eexec_line(unsigned char *line, int line_len, long offset)
+{
+    const char *cs_start = scan.cs_start;
     int cs_start_len = strlen(cs_start);
     int pos;
     int first_space;
     int digits;
+    int word;
+    int subr = -1;
+    const unsigned char *glyph = 0;
+    int glyph_len = 0;
     int cut_newline = 0;
 
     /* append this data to the end of `save' if necessary */
@@ -348,6 +1147,7 @@ eexec_line(unsigned char *line, int line_len)
         append_save(line, line_len);
         line = save;
         line_len = save_len;
+        offset = save_offset;
         save_len = 0;
     }
 
@@ -359,6 +1159,7 @@ eexec_line(unsigned char *line, int line_len)
     /* skip first word */
     for (pos = 0; pos < line_len && isspace(line[pos]); pos++)
         ;
+    word = pos;
     while (pos < line_len && !isspace(line[pos]))
         pos++;
     if (pos >= line_len)
@@ -378,6 +1179,7 @@ eexec_line(unsigned char *line, int line_len)
 
     /* check for subr (another number) */
     if (pos < line_len - 1 && isspace(line[pos]) && isdigit(line[pos+1])) {
+        subr = atoi((const char *)(line + digits));
         first_space = pos;
         digits = pos + 1;
         for (pos = digits; pos < line_len && isdigit(line[pos]); pos++)
@@ -398,13 +1200,32 @@ eexec_line(unsigned char *line, int line_len)
                 line[line_len - 1] = '\n';
                 cut_newline = 1;
             }
-            fprintf(ofp, "%.*s {\n", first_space, line);
-            decrypt_charstring(line + pos + 2 + cs_start_len, cs_len);
+            if (subr < 0 && line[word] == '/') {
+                glyph = line + word + 1;
+                glyph_len = first_space - word - 1;
+            }
+            if (selecting && !charstring_selected(glyph, glyph_len, subr))
+                return cut_newline;
+            if (charstrings_mode == CHARSTRINGS_OMIT)
+                return cut_newline;
+            pending_output(line, first_space);
+            if (charstrings_mode == CHARSTRINGS_PLACEHOLDER) {
+                char buf[40];
+                sprintf(buf, " {...%d bytes...}", cs_len);
+                pending_output((const unsigned char *) buf, strlen(buf));
+                pos += 2 + cs_start_len + cs_len;
+                pending_output(line + pos, line_len - pos);
+                return cut_newline;
+            }
+            pending_charstring_add(line + pos + 2 + cs_start_len, cs_len,
+                                   offset + pos + 2 + cs_start_len,
+                                   subr, glyph, glyph_len);
             pos += 2 + cs_start_len + cs_len;
-            fprintf(ofp, "\t}%.*s", line_len - pos, line + pos);
+            pending_output(line + pos, line_len - pos);
             return cut_newline;
         } else {
             /* not long enough! */
+            save_offset = offset;
             append_save(line, line_len);
             return 0;
         }
@@ -412,28 +1233,36 @@ eexec_line(unsigned char *line, int line_len)
 
     /* otherwise, just output the line */
   not_charstring:
+    scan.events = 0;
+    pos = t1scan_feed(&scan, line, line_len);
+
     /* 6.Oct.2003 - Werner Lemberg reports a stupid Omega font that behaves
        badly: a charstring definition follows "/Charstrings ... begin", ON THE
        SAME LINE. */
-    {
-        unsigned char* csbegin = check_eexec_charstrings_begin(line, line_len);
-        if (csbegin) {
-            int len = csbegin - line;
-            fprintf(ofp, "%.*s\n", len, line);
-            return eexec_line(csbegin, line_len - len);
+    if (scan.events & T1SCAN_EV_CHARSTRINGS_BEGIN) {
+        int csbegin = pos;
+        while (csbegin < line_len && isspace(line[csbegin]))
+            csbegin++;
+        if (csbegin < line_len && line[csbegin] == '/') {
+            if (!selecting) {
+                pending_output(line, csbegin);
+                pending_output((const unsigned char *) "\n", 1);
+            }
+            return eexec_line(line + csbegin, line_len - csbegin,
+                              offset + csbegin);
         }
+        t1scan_feed(&scan, line + pos, line_len - pos);
     }
 
     if (line[line_len - 1] == '\r') {
         line[line_len - 1] = '\n';
         cut_newline = 1;
     }
-    set_lenIV((char*) line, line_len);
-    set_cs_start((char*) line, line_len);
-    fprintf(ofp, "%.*s", line_len, line);
+    if (!selecting)
+        pending_output(line, line_len);
 
-    /* look for `currentfile closefile' to see if we should stop decrypting */
-    if (memmem(line, line_len, "currentfile closefile", 21) != 0)
+    /* stop decrypting after `currentfile closefile' */
+    if (scan.events & T1SCAN_EV_CLOSEFILE)
         in_eexec = -1;
 
     return cut_newline;
@@ -459,7 +1288,7 @@ disasm_output_ascii(char *line, int len)
     /* if we came from a binary section, we need to process that too */
     if (was_in_eexec > 0) {
         unsigned char zero = 0;
-        eexec_line(&zero, 0);
+        eexec_line(&zero, 0, 0);
     }
 
     /* if we just came from the "ASCII part" of an eexec section, we need to
@@ -498,8 +1327,9 @@ disasm_output_ascii(char *line, int len)
         save_len = 0;
     }
 
-    if (!all_zeroes(line))
-        output(line);
+    flush_pending();
+    if (!selecting && !all_zeroes(line))
+        output_text(line, strlen(line));
 }
 
 /* collect until '\n' or end of binary section */
@@ -524,6 +1354,7 @@ disasm_output_binary(unsigned char *data, int len)
         er = er_default;
         ignore_newline = 0;
         in_eexec = 0;
+        eexec_pos = 0;
     }
     if (in_eexec < 4) {
         for (i = 0; i < len && in_eexec < 4; i++, in_eexec++) {
@@ -534,6 +1365,7 @@ disasm_output_binary(unsigned char *data, int len)
         }
         data += i;
         len -= i;
+        eexec_pos += i;
     }
 
     /* now make lines: collect until '\n' or '\r' and pass them off to
@@ -557,14 +1389,18 @@ disasm_output_binary(unsigned char *data, int len)
         }
 
         if (i >= len) {
-            if (start < len)
+            if (start < len) {
+                if (!save_len)
+                    save_offset = eexec_pos + start;
                 append_save(data + start, i - start);
+            }
             break;
         }
 
         i++;
-        ignore_newline = eexec_line(data + start, i - start);
+        ignore_newline = eexec_line(data + start, i - start, eexec_pos + start);
     }
+    eexec_pos += len;
 
     /* if in_eexec < 0, we have some plaintext lines sitting around in a binary
        section of the PFB. save them for later */
@@ -588,10 +1424,26 @@ disasm_output_end(void)
 #define OUTPUT_OPT      301
 #define VERSION_OPT     302
 #define HELP_OPT        303
+#define JOBS_OPT        304
+#define GLYPH_OPT       305
+#define SUBRS_OPT       306
+#define FORMAT_OPT      307
+#define MAX_MEMORY_OPT  308
+#define NO_CHARSTRINGS_OPT 309
+#define OMIT_CHARSTRINGS_OPT 310
+#define SOURCE_MAP_OPT  311
 
 static Clp_Option options[] = {
+  { "format", 'f', FORMAT_OPT, Clp_ValString, 0 },
+  { "glyph", 'g', GLYPH_OPT, Clp_ValString, 0 },
   { "help", 0, HELP_OPT, 0, 0 },
+  { "jobs", 'j', JOBS_OPT, Clp_ValInt, Clp_Optional },
+  { "max-memory", 0, MAX_MEMORY_OPT, Clp_ValString, 0 },
+  { "no-charstrings", 0, NO_CHARSTRINGS_OPT, 0, 0 },
+  { "omit-charstrings", 0, OMIT_CHARSTRINGS_OPT, 0, 0 },
   { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
+  { "source-map", 0, SOURCE_MAP_OPT, Clp_ValString, 0 },
+  { "subrs", 0, SUBRS_OPT, Clp_ValString, 0 },
   { "version", 0, VERSION_OPT, 0, 0 },
 };
 static const char *program_name;
@@ -640,6 +1492,21 @@ Usage: %s [OPTION]... [INPUT [OUTPUT]]\n\
 \n\
 Options:\n\
   -o, --output=FILE             Write output to FILE.\n\
+      --source-map=FILE         Write the location of each charstring in the\n\
+                                output and the input font to FILE.\n\
+  -f, --format=FMT              Write output in format FMT: `text' (the\n\
+                                default), `json', or `binary'.\n\
+  -j, --jobs[=N]                Disassemble charstrings with N threads. The\n\
+                                default N is the number of CPUs.\n\
+      --no-charstrings          Don't decrypt charstrings; print their lengths.\n\
+      --omit-charstrings        Don't decrypt charstrings; leave out their\n\
+                                definitions.\n\
+      --max-memory=SIZE         Fail if buffers need more than SIZE bytes.\n\
+                                SIZE may end in k, M, or G.\n\
+  -g, --glyph=NAME              Print only glyph NAME's charstring. Give more\n\
+                                than once to print several glyphs.\n\
+      --subrs=A-B               Print only Subrs A through B. A-B may be a\n\
+                                single number, and B may be omitted.\n\
   -h, --help                    Print this message and exit.\n\
       --version                 Print version number and warranty and exit.\n\
 \n\
@@ -680,6 +1547,100 @@ main(int argc, char *argv[])
       }
       break;
 
+     case JOBS_OPT:
+      if (!clp->have_val) {
+#if HAVE_SYSCONF && defined(_SC_NPROCESSORS_ONLN)
+        njobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+      } else if (clp->val.i < 1)
+        fatal_error("--jobs must be at least 1");
+      else
+        njobs = clp->val.i;
+      if (njobs < 1)
+        njobs = 1;
+      else if (njobs > 256)
+        njobs = 256;
+      break;
+
+     case FORMAT_OPT: {
+       int i, n = sizeof(formats) / sizeof(formats[0]);
+       for (i = 0; i < n && strcmp(formats[i].name, clp->vstr) != 0; i++)
+         /* nada */;
+       if (i == n)
+         fatal_error("unknown format `%s' (try `text', `json', or `binary')",
+                     clp->vstr);
+       format = &formats[i];
+       break;
+     }
+
+     case SOURCE_MAP_OPT:
+      if (map_file)
+        fatal_error("source map already specified");
+      if (!(map_file = fopen(clp->vstr, "w")))
+        fatal_error("%s: %s", clp->vstr, strerror(errno));
+      fputs("#kind\tkey\tfirst_line\tlast_line\toutput_offset\toutput_length\teexec_offset\teexec_length\n", map_file);
+      break;
+
+     case MAX_MEMORY_OPT: {
+       char *e;
+       max_memory = strtoul(clp->vstr, &e, 10);
+       if (*e == 'k' || *e == 'K')
+         max_memory <<= 10, e++;
+       else if (*e == 'm' || *e == 'M')
+         max_memory <<= 20, e++;
+       else if (*e == 'g' || *e == 'G')
+         max_memory <<= 30, e++;
+       if (e == clp->vstr || *e || max_memory == 0)
+         fatal_error("bad --max-memory size `%s'", clp->vstr);
+       break;
+     }
+
+     case NO_CHARSTRINGS_OPT:
+      charstrings_mode = CHARSTRINGS_PLACEHOLDER;
+      break;
+
+     case OMIT_CHARSTRINGS_OPT:
+      charstrings_mode = CHARSTRINGS_OMIT;
+      break;
+
+     case GLYPH_OPT:
+      select_glyphs = (const char **)
+        grow_buffer(select_glyphs, &select_glyphs_cap,
+                    (nselect_glyphs + 1) * sizeof(const char *));
+      select_glyphs[nselect_glyphs++] = clp->vstr;
+      selecting = 1;
+      break;
+
+     case SUBRS_OPT: {
+       const char *s = clp->vstr;
+       char *e;
+       long first, last;
+       first = strtol(s, &e, 10);
+       if (e == s || first < 0)
+         goto bad_subrs;
+       if (*e == '-') {
+         s = e + 1;
+         if (!*s) {
+           last = INT_MAX;
+           e = (char *) s;
+         } else if ((last = strtol(s, &e, 10)) < first || e == s)
+           goto bad_subrs;
+       } else
+         last = first;
+       if (*e)
+         goto bad_subrs;
+       select_subrs = (int *)
+         grow_buffer(select_subrs, &select_subrs_cap,
+                     (nselect_subrs + 2) * sizeof(int));
+       select_subrs[nselect_subrs++] = (int) first;
+       select_subrs[nselect_subrs++] = (int) (last > INT_MAX ? INT_MAX : last);
+       selecting = 1;
+       break;
+     bad_subrs:
+       fatal_error("bad --subrs range `%s' (try `A-B')", clp->vstr);
+       break;
+     }
+
      case HELP_OPT:
       usage();
       exit(0);
@@ -722,14 +1683,40 @@ particular purpose.\n");
  done:
   if (!ifp) ifp = stdin;
   if (!ofp) ofp = stdout;
+  if (!format) format = &formats[0];
 
 #if defined(_MSDOS) || defined(_WIN32)
   /* As we might be processing a PFB (binary) input file, we must set its file
      mode to binary. */
   _setmode(_fileno(ifp), _O_BINARY);
+  if (strcmp(format->name, "binary") == 0)
+    _setmode(_fileno(ofp), _O_BINARY);
+#endif
+
+#if !HAVE_PTHREADS
+  if (njobs > 1) {
+    error("warning: threads not supported, ignoring --jobs");
+    njobs = 1;
+  }
 #endif
 
-  /* prepare font reader */
+  if (nselect_glyphs) {
+    qsort(select_glyphs, nselect_glyphs, sizeof(const char *), glyph_sort);
+    if (!(select_glyph_found = (char *) calloc(nselect_glyphs, 1)))
+      fatal_error("out of memory");
+    charge_memory(nselect_glyphs);
+  }
+
+  /* prepare output buffer, jobs, scanner and font reader */
+  out.f = ofp;
+  out.s = (char *) grow_buffer(0, &out.cap, OUTBUF_SIZE);
+  out.start = 1;
+  start_jobs();
+  t1scan_init(&scan);
+  scan.skip_binary = 1;
+  scan.stop_events = T1SCAN_EV_CHARSTRINGS_BEGIN;
+  if (format->begin)
+    format->begin();
   fr.output_ascii = disasm_output_ascii;
   fr.output_binary = disasm_output_binary;
   fr.output_end = disasm_output_end;
@@ -747,6 +1734,17 @@ particular purpose.\n");
     fatal_error("%s does not start with font marker (`%%' or 0x80)", ifp_filename);
 
   fclose(ifp);
+  stop_jobs();
+  if (format->text_end)
+    format->text_end();
+  if (format->end)
+    format->end();
+  outbuf_flush(&out);
+  if (map_file)
+    fclose(map_file);
+  for (c = 0; c < nselect_glyphs; c++)
+    if (!select_glyph_found[c])
+      error("glyph `%s' not found", select_glyphs[c]);
   fclose(ofp);
 
   if (unknown)
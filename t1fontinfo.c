@@ -0,0 +1,290 @@
+/* t1fontinfo
+ *
+ * This file contains functions for reading metadata from Type 1 fonts in
+ * PFA or PFB format without decrypting their charstrings, and for
+ * collecting their encrypted charstrings.
+ *
+ * Copyright (c) 1998-2017 Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, subject to the
+ * conditions listed in the Click LICENSE file, which is available in full at
+ * http://github.com/kohler/click/blob/master/LICENSE. The conditions
+ * include: you must preserve this copyright notice, and you cannot mention
+ * the copyright holders in advertising related to the Software without
+ * their permission. The Software is provided WITHOUT ANY WARRANTY, EXPRESS
+ * OR IMPLIED. This notice is a summary of the Click LICENSE file; the
+ * license in that file is binding.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "t1lib.h"
+#include "t1scan.h"
+#include "t1fontinfo.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The font_reader callbacks take no context argument, so reader state is
+   kept here while read_font_info runs. */
+
+static struct font_info *fi;
+static struct t1scan scan;
+static int done;
+
+static int in_eexec;
+static uint16_t er;
+
+/* This function decrypts `len' bytes of eexec data in place. */
+
+static void
+eexec_decrypt(unsigned char *data, int len)
+{
+    int i;
+    for (i = 0; i < len; i++) {
+	unsigned cipher = data[i];
+	data[i] = (unsigned char) (cipher ^ (er >> 8));
+	er = (uint16_t) ((cipher + er) * 52845 + 22719);
+    }
+}
+
+/* This function feeds text to the scanner, stopping at /CharStrings:
+   everything we want comes before the charstrings. */
+
+static void
+info_feed(const unsigned char *data, int len)
+{
+    t1scan_feed(&scan, data, len);
+    if (scan.events & T1SCAN_EV_CHARSTRINGS)
+	fi->complete = done = 1;
+}
+
+static void
+info_output_ascii(char *line, int len)
+{
+    if (done)
+	return;
+    if (len < 0)
+	len = strlen(line);
+    in_eexec = 0;
+    info_feed((const unsigned char *) line, len);
+}
+
+static void
+info_output_binary(unsigned char *data, int len)
+{
+    /* eexec initialization */
+    if (in_eexec == 0)
+	er = 55665;
+
+    /* decrypt in small pieces so we stop soon after /CharStrings */
+    while (len > 0 && !done) {
+	int n = (len > 512 ? 512 : len), i;
+	eexec_decrypt(data, n);
+	/* the first four plaintext bytes are random */
+	for (i = 0; i < n && in_eexec < 4; i++)
+	    in_eexec++;
+	info_feed(data + i, n - i);
+	data += n;
+	len -= n;
+    }
+}
+
+static void
+info_output_end(void)
+{
+    if (!done)
+	t1scan_end(&scan);
+}
+
+void
+read_font_info(FILE *f, const char *filename, struct font_info *info)
+{
+    struct font_reader fr;
+    int c;
+
+    memset(info, 0, sizeof(*info));
+    fi = info;
+    done = in_eexec = 0;
+    t1scan_init(&scan);
+    scan.skip_binary = 1;
+    scan.stop_events = T1SCAN_EV_CHARSTRINGS;
+
+    fr.output_ascii = info_output_ascii;
+    fr.output_binary = info_output_binary;
+    fr.output_end = info_output_end;
+
+    /* peek at first byte to see if it is the PFB marker 0x80 */
+    c = getc(f);
+    ungetc(c, f);
+    if (c == PFB_MARKER)
+	process_pfb(f, filename, &fr);
+    else if (c == '%')
+	process_pfa(f, filename, &fr);
+    else
+	error("%s does not start with font marker (`%%' or 0x80)", filename);
+
+    /* the values now belong to `info' */
+    memcpy(info->value, scan.value, sizeof(info->value));
+    memset(scan.value, 0, sizeof(scan.value));
+    info->encoding_entries = scan.encoding_entries;
+}
+
+void
+free_font_info(struct font_info *info)
+{
+    int i;
+    for (i = 0; i < T1K_NKEYS; i++) {
+	free(info->value[i]);
+	info->value[i] = 0;
+    }
+}
+
+
+
+/*****
+ * Charstrings
+ **/
+
+static struct font_charstring *fcs;
+static int nfcs, fcs_cap;
+static long capture_left;
+
+static void
+cs_feed(unsigned char *data, int len)
+{
+    while (len > 0) {
+	int n;
+
+	/* copy charstring data; the scanner skips it */
+	if (capture_left > 0) {
+	    struct font_charstring *c = &fcs[nfcs - 1];
+	    n = (capture_left < len ? (int) capture_left : len);
+	    memcpy(c->data + c->len, data, n);
+	    c->len += n;
+	    capture_left -= n;
+	}
+
+	scan.events = 0;
+	n = t1scan_feed(&scan, data, len);
+	if ((scan.events & T1SCAN_EV_BINARY) && scan.skip > 0
+	    && scan.skip <= INT_MAX) {
+	    struct font_charstring *c;
+	    int name_len = strlen(scan.binary_name);
+	    if (nfcs == fcs_cap) {
+		fcs_cap = (fcs_cap ? 2 * fcs_cap : 256);
+		fcs = (struct font_charstring *)
+		    realloc(fcs, fcs_cap * sizeof(struct font_charstring));
+		if (!fcs)
+		    fatal_error("out of memory");
+	    }
+	    c = &fcs[nfcs];
+	    c->subr = (name_len ? -1 : (int) scan.binary_subr);
+	    c->name = 0;
+	    c->lenIV = scan.lenIV;
+	    c->data = (unsigned char *) malloc(scan.skip);
+	    c->len = 0;
+	    if (name_len && (c->name = (char *) malloc(name_len + 1)))
+		memcpy(c->name, scan.binary_name, name_len + 1);
+	    if (!c->data || (name_len && !c->name))
+		fatal_error("out of memory");
+	    nfcs++;
+	    capture_left = scan.skip;
+	}
+	data += n;
+	len -= n;
+    }
+}
+
+static void
+cs_output_ascii(char *line, int len)
+{
+    if (len < 0)
+	len = strlen(line);
+    in_eexec = 0;
+    t1scan_feed(&scan, (const unsigned char *) line, len);
+}
+
+static void
+cs_output_binary(unsigned char *data, int len)
+{
+    int i;
+
+    /* eexec initialization */
+    if (in_eexec == 0)
+	er = 55665;
+
+    eexec_decrypt(data, len);
+    /* the first four plaintext bytes are random */
+    for (i = 0; i < len && in_eexec < 4; i++)
+	in_eexec++;
+    cs_feed(data + i, len - i);
+}
+
+static void
+cs_output_end(void)
+{
+    t1scan_end(&scan);
+}
+
+int
+read_font_charstrings(FILE *f, const char *filename,
+		      struct font_charstring **csp)
+{
+    struct font_reader fr;
+    int c;
+
+    fcs = 0;
+    nfcs = fcs_cap = 0;
+    capture_left = 0;
+    in_eexec = 0;
+    t1scan_init(&scan);
+    scan.skip_binary = 1;
+    scan.stop_events = T1SCAN_EV_BINARY;
+
+    fr.output_ascii = cs_output_ascii;
+    fr.output_binary = cs_output_binary;
+    fr.output_end = cs_output_end;
+
+    c = getc(f);
+    ungetc(c, f);
+    if (c == PFB_MARKER)
+	process_pfb(f, filename, &fr);
+    else if (c == '%')
+	process_pfa(f, filename, &fr);
+    else
+	error("%s does not start with font marker (`%%' or 0x80)", filename);
+
+    /* a charstring cut off by the end of the font is incomplete */
+    if (capture_left > 0) {
+	nfcs--;
+	free(fcs[nfcs].name);
+	free(fcs[nfcs].data);
+    }
+
+    t1scan_clear(&scan);
+    *csp = fcs;
+    return nfcs;
+}
+
+void
+free_font_charstrings(struct font_charstring *cs, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+	free(cs[i].name);
+	free(cs[i].data);
+    }
+    free(cs);
+}
+
+#ifdef __cplusplus
+}
+#endif
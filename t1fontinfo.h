@@ -0,0 +1,41 @@
+#ifndef T1FONTINFO_H
+#define T1FONTINFO_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Font metadata read from the cleartext header and the Private dictionary.
+   Reading stops at the start of /CharStrings, so no charstring is ever
+   decrypted. Values are indexed by the T1K_ keys in t1scan.h; a null value
+   means the font didn't define that key. */
+
+struct font_info {
+  char *value[T1K_NKEYS];
+  int encoding_entries;         /* number of entries in a custom Encoding */
+  int complete;                 /* 1 if /CharStrings was reached */
+};
+
+void read_font_info(FILE *, const char *filename, struct font_info *);
+void free_font_info(struct font_info *);
+
+/* A charstring as it appears in the font, still encrypted unless lenIV is
+   negative. */
+
+struct font_charstring {
+  int subr;                     /* Subr index, or -1 for a glyph */
+  char *name;                   /* glyph name, or null for a Subr */
+  int lenIV;                    /* the font's lenIV at this charstring */
+  unsigned char *data;
+  int len;
+};
+
+/* Returns the number of charstrings in the font, and an array of them in
+   `*csp', to be freed with free_font_charstrings. */
+int read_font_charstrings(FILE *, const char *filename,
+			  struct font_charstring **csp);
+void free_font_charstrings(struct font_charstring *, int n);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
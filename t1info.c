@@ -0,0 +1,352 @@
+/* t1info
+ *
+ * This program prints metadata about Adobe Type 1 fonts in PFA or PFB
+ * format, such as the font name, bounding box, encoding, Private dictionary
+ * values, and number of glyphs. It decrypts only the part of the eexec
+ * section that precedes the charstrings.
+ *
+ * Copyright (c) 1998-2017 Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, subject to the
+ * conditions listed in the Click LICENSE file, which is available in full at
+ * http://github.com/kohler/click/blob/master/LICENSE. The conditions
+ * include: you must preserve this copyright notice, and you cannot mention
+ * the copyright holders in advertising related to the Software without
+ * their permission. The Software is provided WITHOUT ANY WARRANTY, EXPRESS
+ * OR IMPLIED. This notice is a summary of the Click LICENSE file; the
+ * license in that file is binding.
+ */
+
+/* Note: this is ANSI C. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#if defined(_MSDOS) || defined(_WIN32)
+# include <fcntl.h>
+# include <io.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <lcdf/clp.h>
+#include "t1lib.h"
+#include "t1scan.h"
+#include "t1fontinfo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static FILE *ofp;
+static int json = 0;
+static int error_count = 0;
+
+
+/*****
+ * Output
+ **/
+
+static void
+json_string(const char *s)
+{
+  putc('"', ofp);
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\')
+      fprintf(ofp, "\\%c", c);
+    else if (c == '\n')
+      fputs("\\n", ofp);
+    else if (c < 32 || c >= 127)
+      fprintf(ofp, "\\u%04x", c);
+    else
+      putc(c, ofp);
+  }
+  putc('"', ofp);
+}
+
+/* PostScript numbers like `.5', `+3' or `16#FF' aren't valid JSON: print
+   them in C format if they are decimal, and as strings otherwise. */
+
+static int
+is_json_number(const char *s, int len)
+{
+  const char *end = s + len;
+  if (s < end && *s == '-')
+    s++;
+  if (s == end || !isdigit((unsigned char) *s)
+      || (*s == '0' && s + 1 < end && isdigit((unsigned char) s[1])))
+    return 0;
+  while (s < end && isdigit((unsigned char) *s))
+    s++;
+  if (s < end && *s == '.') {
+    if (++s == end || !isdigit((unsigned char) *s))
+      return 0;
+    while (s < end && isdigit((unsigned char) *s))
+      s++;
+  }
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    if (++s < end && (*s == '+' || *s == '-'))
+      s++;
+    if (s == end || !isdigit((unsigned char) *s))
+      return 0;
+    while (s < end && isdigit((unsigned char) *s))
+      s++;
+  }
+  return s == end;
+}
+
+static void
+json_number(const char *s, int len)
+{
+  char buf[64];
+  char *end;
+  double d;
+  if (is_json_number(s, len))
+    fprintf(ofp, "%.*s", len, s);
+  else if (len < (int) sizeof(buf)) {
+    memcpy(buf, s, len);
+    buf[len] = 0;
+    d = strtod(buf, &end);
+    if (len && end == buf + len && strchr(buf, '#') == 0)
+      fprintf(ofp, "%.10g", d);
+    else
+      json_string(buf);
+  } else
+    fputs("null", ofp);
+}
+
+static void
+json_array(const char *s)
+{
+  const char *sep = "";
+  putc('[', ofp);
+  while (*s) {
+    const char *e = strchr(s, ' ');
+    int len = (e ? e - s : (int) strlen(s));
+    fputs(sep, ofp);
+    json_number(s, len);
+    sep = ", ";
+    s += len + (e != 0);
+  }
+  putc(']', ofp);
+}
+
+static void
+print_info(const char *filename, const struct font_info *fi, int nfiles)
+{
+  int i;
+  const char *sep = "";
+
+  if (json) {
+    putc('{', ofp);
+    if (nfiles > 1) {
+      fputs("\"File\": ", ofp);
+      json_string(filename);
+      sep = ", ";
+    }
+    for (i = 0; i < T1K_NKEYS; i++)
+      if (fi->value[i]) {
+        fprintf(ofp, "%s\"%s\": ", sep, t1scan_keys[i].name);
+        if (t1scan_keys[i].type == T1K_TYPE_NUMBER)
+          json_number(fi->value[i], strlen(fi->value[i]));
+        else if (t1scan_keys[i].type == T1K_TYPE_ARRAY)
+          json_array(fi->value[i]);
+        else
+          json_string(fi->value[i]);
+        if (i == T1K_ENCODING && strcmp(fi->value[i], "custom") == 0)
+          fprintf(ofp, ", \"EncodingEntries\": %d", fi->encoding_entries);
+        sep = ", ";
+      }
+    fputs("}\n", ofp);
+
+  } else {
+    if (nfiles > 1)
+      fprintf(ofp, "File: %s\n", filename);
+    for (i = 0; i < T1K_NKEYS; i++)
+      if (fi->value[i]) {
+        fprintf(ofp, "%s: %s\n", t1scan_keys[i].name, fi->value[i]);
+        if (i == T1K_ENCODING && strcmp(fi->value[i], "custom") == 0)
+          fprintf(ofp, "EncodingEntries: %d\n", fi->encoding_entries);
+      }
+  }
+}
+
+
+/*****
+ * Command line
+ **/
+
+#define OUTPUT_OPT      301
+#define VERSION_OPT     302
+#define HELP_OPT        303
+#define JSON_OPT        304
+
+static Clp_Option options[] = {
+  { "help", 0, HELP_OPT, 0, 0 },
+  { "json", 'j', JSON_OPT, 0, 0 },
+  { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
+  { "version", 0, VERSION_OPT, 0, 0 },
+};
+static const char *program_name;
+
+void
+fatal_error(const char *message, ...)
+{
+  va_list val;
+  va_start(val, message);
+  fprintf(stderr, "%s: ", program_name);
+  vfprintf(stderr, message, val);
+  fputc('\n', stderr);
+  va_end(val);
+  exit(1);
+}
+
+void
+error(const char *message, ...)
+{
+  va_list val;
+  va_start(val, message);
+  fprintf(stderr, "%s: ", program_name);
+  vfprintf(stderr, message, val);
+  fputc('\n', stderr);
+  error_count++;
+  va_end(val);
+}
+
+static void
+short_usage(void)
+{
+  fprintf(stderr, "Usage: %s [OPTION]... [FONT...]\n\
+Try `%s --help' for more information.\n",
+          program_name, program_name);
+}
+
+static void
+usage(void)
+{
+  printf("\
+`T1info' prints the names, bounding box, encoding, Private dictionary values\n\
+and glyph count of PostScript Type 1 fonts in PFB or PFA format. It stops\n\
+reading each font where its charstrings begin. The result is written to the\n\
+standard output.\n\
+\n\
+Usage: %s [OPTION]... [FONT...]\n\
+\n\
+Options:\n\
+  -j, --json                    Print one JSON object per font.\n\
+  -o, --output=FILE             Write output to FILE.\n\
+  -h, --help                    Print this message and exit.\n\
+      --version                 Print version number and warranty and exit.\n\
+\n\
+Report bugs to <ekohler@gmail.com>.\n", program_name);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+
+int
+main(int argc, char *argv[])
+{
+  struct font_info fi;
+  const char **files;
+  int nfiles = 0;
+  int i;
+
+  Clp_Parser *clp =
+    Clp_NewParser(argc, (const char * const *)argv, sizeof(options) / sizeof(options[0]), options);
+  program_name = Clp_ProgramName(clp);
+
+  if (!(files = (const char **) malloc(sizeof(const char *) * (argc + 1))))
+    fatal_error("out of memory");
+
+  /* interpret command line arguments using CLP */
+  while (1) {
+    int opt = Clp_Next(clp);
+    switch (opt) {
+
+     case OUTPUT_OPT:
+      if (ofp)
+        fatal_error("output file already specified");
+      if (strcmp(clp->vstr, "-") == 0)
+        ofp = stdout;
+      else {
+        ofp = fopen(clp->vstr, "w");
+        if (!ofp) fatal_error("%s: %s", clp->vstr, strerror(errno));
+      }
+      break;
+
+     case JSON_OPT:
+      json = 1;
+      break;
+
+     case HELP_OPT:
+      usage();
+      exit(0);
+      break;
+
+     case VERSION_OPT:
+      printf("t1info (LCDF t1utils) %s\n", VERSION);
+      printf("Copyright (C) 1998-2017 Eddie Kohler et al.\n\
+This is free software; see the source for copying conditions.\n\
+There is NO warranty, not even for merchantability or fitness for a\n\
+particular purpose.\n");
+      exit(0);
+      break;
+
+     case Clp_NotOption:
+      files[nfiles++] = clp->vstr;
+      break;
+
+     case Clp_Done:
+      goto done;
+
+     case Clp_BadOption:
+      short_usage();
+      exit(1);
+      break;
+
+    }
+  }
+
+ done:
+  if (!ofp) ofp = stdout;
+  if (!nfiles)
+    files[nfiles++] = "-";
+
+  for (i = 0; i < nfiles; i++) {
+    FILE *ifp;
+    const char *ifp_filename = files[i];
+    if (strcmp(files[i], "-") == 0) {
+      ifp = stdin;
+      ifp_filename = "<stdin>";
+#if defined(_MSDOS) || defined(_WIN32)
+      _setmode(_fileno(ifp), _O_BINARY);
+#endif
+    } else if (!(ifp = fopen(files[i], "rb"))) {
+      error("%s: %s", files[i], strerror(errno));
+      continue;
+    }
+
+    read_font_info(ifp, ifp_filename, &fi);
+    if (!fi.complete)
+      error("%s: no /CharStrings found", ifp_filename);
+    if (!json && i > 0)
+      putc('\n', ofp);
+    print_info(ifp_filename, &fi, nfiles);
+    free_font_info(&fi);
+
+    if (ifp != stdin)
+      fclose(ifp);
+  }
+
+  fclose(ofp);
+  return (error_count ? 1 : 0);
+}
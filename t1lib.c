@@ -24,6 +24,12 @@
 #include <ctype.h>
 #include <string.h>
 #include "t1lib.h"
+#if HAVE_CPUID_H && HAVE_IMMINTRIN_H && defined(__GNUC__) \
+    && (defined(__x86_64__) || defined(__i386__))
+# define T1_X86_KERNELS 1
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -444,6 +450,399 @@ crcbuf(int crc, unsigned int len, const char *buf)
     return crc;
 }
 
+
+/* Byte kernels. Each kernel has a scalar version and, on x86 compilers
+   that support it, SSE2, SSSE3 and AVX2 versions. The version is chosen the
+   first time a kernel runs: the best one the CPU supports, or the one named
+   by the T1UTILS_KERNELS environment variable ("scalar", "sse2", "ssse3" or
+   "avx2"), which is useful for benchmarking. All versions produce identical
+   output. */
+
+#define CS_C1		52845
+#define CS_C2		22719
+
+typedef void (*cs_rows_func)(unsigned char *, int, uint16_t *);
+
+/* Charstring cipher on a block of NROWS rows of CHARSTRING_LANES bytes, one
+   byte per lane per row; R holds each lane's cipher state. */
+
+static void
+cs_decrypt_rows_scalar(unsigned char *rows, int nrows, uint16_t *r)
+{
+    int i, k;
+    for (i = 0; i < nrows; i++, rows += CHARSTRING_LANES)
+	for (k = 0; k < CHARSTRING_LANES; k++) {
+	    unsigned cipher = rows[k];
+	    rows[k] = (unsigned char) (cipher ^ (r[k] >> 8));
+	    r[k] = (uint16_t) ((cipher + r[k]) * CS_C1 + CS_C2);
+	}
+}
+
+static void
+cs_encrypt_rows_scalar(unsigned char *rows, int nrows, uint16_t *r)
+{
+    int i, k;
+    for (i = 0; i < nrows; i++, rows += CHARSTRING_LANES)
+	for (k = 0; k < CHARSTRING_LANES; k++) {
+	    unsigned cipher = (rows[k] ^ (r[k] >> 8)) & 0xFF;
+	    rows[k] = (unsigned char) cipher;
+	    r[k] = (uint16_t) ((cipher + r[k]) * CS_C1 + CS_C2);
+	}
+}
+
+/* Hexadecimal encoding: write 2*LEN lowercase hex digits for SRC to DST. */
+
+static const char hexchar[] = "0123456789abcdef";
+
+static void
+hex_encode_scalar(char *dst, const unsigned char *src, int len)
+{
+    for (; len > 0; len--, src++) {
+	*dst++ = hexchar[*src >> 4];
+	*dst++ = hexchar[*src & 0xF];
+    }
+}
+
+#if T1_X86_KERNELS
+# define CS_SSE2_LOAD(rows, zero, lo, hi) do { \
+	__m128i row__ = _mm_loadu_si128((const __m128i *) (rows)); \
+	lo = _mm_unpacklo_epi8(row__, zero); \
+	hi = _mm_unpackhi_epi8(row__, zero); \
+    } while (0)
+
+__attribute__((target("sse2"))) static void
+cs_decrypt_rows_sse2(unsigned char *rows, int nrows, uint16_t *r)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k1 = _mm_set1_epi16((short) CS_C1);
+    const __m128i k2 = _mm_set1_epi16((short) CS_C2);
+    __m128i rlo = _mm_loadu_si128((const __m128i *) r);
+    __m128i rhi = _mm_loadu_si128((const __m128i *) (r + 8));
+    int i;
+    for (i = 0; i < nrows; i++, rows += CHARSTRING_LANES) {
+	__m128i clo, chi, plo, phi;
+	CS_SSE2_LOAD(rows, zero, clo, chi);
+	plo = _mm_xor_si128(clo, _mm_srli_epi16(rlo, 8));
+	phi = _mm_xor_si128(chi, _mm_srli_epi16(rhi, 8));
+	rlo = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(clo, rlo), k1), k2);
+	rhi = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(chi, rhi), k1), k2);
+	_mm_storeu_si128((__m128i *) rows, _mm_packus_epi16(plo, phi));
+    }
+    _mm_storeu_si128((__m128i *) r, rlo);
+    _mm_storeu_si128((__m128i *) (r + 8), rhi);
+}
+
+__attribute__((target("sse2"))) static void
+cs_encrypt_rows_sse2(unsigned char *rows, int nrows, uint16_t *r)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k1 = _mm_set1_epi16((short) CS_C1);
+    const __m128i k2 = _mm_set1_epi16((short) CS_C2);
+    __m128i rlo = _mm_loadu_si128((const __m128i *) r);
+    __m128i rhi = _mm_loadu_si128((const __m128i *) (r + 8));
+    int i;
+    for (i = 0; i < nrows; i++, rows += CHARSTRING_LANES) {
+	__m128i plo, phi, clo, chi;
+	CS_SSE2_LOAD(rows, zero, plo, phi);
+	clo = _mm_xor_si128(plo, _mm_srli_epi16(rlo, 8));
+	chi = _mm_xor_si128(phi, _mm_srli_epi16(rhi, 8));
+	rlo = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(clo, rlo), k1), k2);
+	rhi = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(chi, rhi), k1), k2);
+	_mm_storeu_si128((__m128i *) rows, _mm_packus_epi16(clo, chi));
+    }
+    _mm_storeu_si128((__m128i *) r, rlo);
+    _mm_storeu_si128((__m128i *) (r + 8), rhi);
+}
+
+__attribute__((target("avx2"))) static void
+cs_decrypt_rows_avx2(unsigned char *rows, int nrows, uint16_t *r)
+{
+    const __m256i k1 = _mm256_set1_epi16((short) CS_C1);
+    const __m256i k2 = _mm256_set1_epi16((short) CS_C2);
+    __m256i rv = _mm256_loadu_si256((const __m256i *) r);
+    int i;
+    for (i = 0; i < nrows; i++, rows += CHARSTRING_LANES) {
+	__m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) rows));
+	__m256i p = _mm256_xor_si256(c, _mm256_srli_epi16(rv, 8));
+	rv = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_add_epi16(c, rv), k1), k2);
+	_mm_storeu_si128((__m128i *) rows,
+			 _mm_packus_epi16(_mm256_castsi256_si128(p),
+					  _mm256_extracti128_si256(p, 1)));
+    }
+    _mm256_storeu_si256((__m256i *) r, rv);
+}
+
+__attribute__((target("avx2"))) static void
+cs_encrypt_rows_avx2(unsigned char *rows, int nrows, uint16_t *r)
+{
+    const __m256i k1 = _mm256_set1_epi16((short) CS_C1);
+    const __m256i k2 = _mm256_set1_epi16((short) CS_C2);
+    __m256i rv = _mm256_loadu_si256((const __m256i *) r);
+    int i;
+    for (i = 0; i < nrows; i++, rows += CHARSTRING_LANES) {
+	__m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) rows));
+	__m256i c = _mm256_xor_si256(p, _mm256_srli_epi16(rv, 8));
+	rv = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_add_epi16(c, rv), k1), k2);
+	_mm_storeu_si128((__m128i *) rows,
+			 _mm_packus_epi16(_mm256_castsi256_si128(c),
+					  _mm256_extracti128_si256(c, 1)));
+    }
+    _mm256_storeu_si256((__m256i *) r, rv);
+}
+
+/* SSE2 has no byte shuffle, so map nibbles to digits arithmetically:
+   '0' + n, plus 'a' - '0' - 10 when n > 9. */
+
+__attribute__((target("sse2"))) static void
+hex_encode_sse2(char *dst, const unsigned char *src, int len)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+    for (; len >= 16; len -= 16, src += 16, dst += 32) {
+	__m128i x = _mm_loadu_si128((const __m128i *) src);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+	__m128i lo = _mm_and_si128(x, mask);
+	__m128i a = _mm_unpacklo_epi8(hi, lo), b = _mm_unpackhi_epi8(hi, lo);
+	a = _mm_add_epi8(_mm_add_epi8(a, zero_char),
+			 _mm_and_si128(_mm_cmpgt_epi8(a, nine), letter_gap));
+	b = _mm_add_epi8(_mm_add_epi8(b, zero_char),
+			 _mm_and_si128(_mm_cmpgt_epi8(b, nine), letter_gap));
+	_mm_storeu_si128((__m128i *) dst, a);
+	_mm_storeu_si128((__m128i *) (dst + 16), b);
+    }
+    hex_encode_scalar(dst, src, len);
+}
+
+__attribute__((target("ssse3"))) static void
+hex_encode_ssse3(char *dst, const unsigned char *src, int len)
+{
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i table = _mm_loadu_si128((const __m128i *) hexchar);
+    for (; len >= 16; len -= 16, src += 16, dst += 32) {
+	__m128i x = _mm_loadu_si128((const __m128i *) src);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+	__m128i lo = _mm_and_si128(x, mask);
+	_mm_storeu_si128((__m128i *) dst,
+			 _mm_shuffle_epi8(table, _mm_unpacklo_epi8(hi, lo)));
+	_mm_storeu_si128((__m128i *) (dst + 16),
+			 _mm_shuffle_epi8(table, _mm_unpackhi_epi8(hi, lo)));
+    }
+    hex_encode_scalar(dst, src, len);
+}
+
+__attribute__((target("avx2"))) static void
+hex_encode_avx2(char *dst, const unsigned char *src, int len)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    const __m256i table =
+	_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) hexchar));
+    for (; len >= 32; len -= 32, src += 32, dst += 64) {
+	__m256i x = _mm256_loadu_si256((const __m256i *) src);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+	__m256i lo = _mm256_and_si256(x, mask);
+	/* unpack works within 128-bit halves; permute restores byte order */
+	__m256i a = _mm256_shuffle_epi8(table, _mm256_unpacklo_epi8(hi, lo));
+	__m256i b = _mm256_shuffle_epi8(table, _mm256_unpackhi_epi8(hi, lo));
+	_mm256_storeu_si256((__m256i *) dst, _mm256_permute2x128_si256(a, b, 0x20));
+	_mm256_storeu_si256((__m256i *) (dst + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    hex_encode_ssse3(dst, src, len);
+}
+
+# define CPU_SSE2	1
+# define CPU_SSSE3	2
+# define CPU_AVX2	4
+
+static int
+cpu_features(void)
+{
+    unsigned a, b, c, d;
+    int f = 0;
+    if (!__get_cpuid(1, &a, &b, &c, &d))
+	return 0;
+    if (d & bit_SSE2)
+	f |= CPU_SSE2;
+    if (c & bit_SSSE3)
+	f |= CPU_SSSE3;
+    /* AVX2 also needs the OS to save YMM state (OSXSAVE and XCR0) */
+    if ((c & bit_OSXSAVE) && __get_cpuid_max(0, 0) >= 7) {
+	unsigned xcr0_lo, xcr0_hi;
+	__asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	(void) xcr0_hi;
+	__cpuid_count(7, 0, a, b, c, d);
+	if ((xcr0_lo & 6) == 6 && (b & bit_AVX2))
+	    f |= CPU_AVX2;
+    }
+    return f;
+}
+#endif
+
+struct kernels {
+    const char *name;
+    int cpu;			/* required CPU features */
+    cs_rows_func cs_decrypt_rows;
+    cs_rows_func cs_encrypt_rows;
+    void (*hex_encode)(char *, const unsigned char *, int);
+};
+
+static const struct kernels kernel_variants[] = {
+    { "scalar", 0,
+      cs_decrypt_rows_scalar, cs_encrypt_rows_scalar, hex_encode_scalar },
+#if T1_X86_KERNELS
+    { "sse2", CPU_SSE2,
+      cs_decrypt_rows_sse2, cs_encrypt_rows_sse2, hex_encode_sse2 },
+    { "ssse3", CPU_SSE2 | CPU_SSSE3,
+      cs_decrypt_rows_sse2, cs_encrypt_rows_sse2, hex_encode_ssse3 },
+    { "avx2", CPU_SSE2 | CPU_SSSE3 | CPU_AVX2,
+      cs_decrypt_rows_avx2, cs_encrypt_rows_avx2, hex_encode_avx2 },
+#endif
+};
+
+static const struct kernels *kernels;
+
+static const struct kernels *
+init_kernels(void)
+{
+    const char *want = getenv("T1UTILS_KERNELS");
+    int nvariants = sizeof(kernel_variants) / sizeof(kernel_variants[0]);
+    int cpu = 0, i;
+#if T1_X86_KERNELS
+    cpu = cpu_features();
+#endif
+
+    kernels = &kernel_variants[0];
+    for (i = 0; i < nvariants; i++)
+	if ((kernel_variants[i].cpu & cpu) == kernel_variants[i].cpu) {
+	    if (want && *want && strcmp(want, kernel_variants[i].name) == 0)
+		return (kernels = &kernel_variants[i]);
+	    kernels = &kernel_variants[i];
+	}
+
+    if (want && *want)
+	error("warning: T1UTILS_KERNELS=%s not available, using %s",
+	      want, kernels->name);
+    return kernels;
+}
+
+/* Return the name of the kernel version in use. */
+
+const char *
+kernel_variant(void)
+{
+    return (kernels ? kernels : init_kernels())->name;
+}
+
+void
+hex_encode(char *dst, const unsigned char *src, int len)
+{
+    (kernels ? kernels : init_kernels())->hex_encode(dst, src, len);
+}
+
+
+/* Batch charstring encryption and decryption. Charstrings are processed in
+   groups of CHARSTRING_LANES. Each group is transposed into a block of rows,
+   one byte per lane per row, so the row kernels run the cipher on all lanes
+   at once. Charstrings are grouped by length so short ones don't pad out
+   long ones. */
+
+#define CS_BLOCK	64	/* rows per transposed block */
+
+static void
+cs_crypt_group(unsigned char **cs, const int *len, int n, cs_rows_func f)
+{
+    unsigned char rows[CS_BLOCK * CHARSTRING_LANES];
+    uint16_t r[CHARSTRING_LANES];
+    int maxlen = 0, pos, i, k;
+
+    for (k = 0; k < CHARSTRING_LANES; k++)
+	r[k] = CHARSTRING_KEY;
+    for (k = 0; k < n; k++)
+	if (len[k] > maxlen)
+	    maxlen = len[k];
+
+    for (pos = 0; pos < maxlen; pos += CS_BLOCK) {
+	int nrows = (maxlen - pos < CS_BLOCK ? maxlen - pos : CS_BLOCK);
+	memset(rows, 0, sizeof(rows));
+	for (k = 0; k < n; k++)
+	    for (i = pos; i < len[k] && i < pos + nrows; i++)
+		rows[(i - pos) * CHARSTRING_LANES + k] = cs[k][i];
+	f(rows, nrows, r);
+	for (k = 0; k < n; k++)
+	    for (i = pos; i < len[k] && i < pos + nrows; i++)
+		cs[k][i] = rows[(i - pos) * CHARSTRING_LANES + k];
+    }
+}
+
+/* Sort entries carry their length so the comparison needs no global state;
+   batches may be processed by several threads at once. */
+
+struct cs_sort_entry {
+    int len;
+    int index;
+};
+
+static int CDECL
+cs_length_compare(const void *a, const void *b)
+{
+    int la = ((const struct cs_sort_entry *) a)->len;
+    int lb = ((const struct cs_sort_entry *) b)->len;
+    return (la > lb ? -1 : la < lb);
+}
+
+static void
+cs_crypt_batch(unsigned char **cs, const int *len, int n, cs_rows_func f)
+{
+    unsigned char *gcs[CHARSTRING_LANES];
+    int glen[CHARSTRING_LANES];
+    struct cs_sort_entry *order;
+    int i, k;
+
+    if (n <= 0)
+	return;
+    if (!(order = (struct cs_sort_entry *) malloc(sizeof(*order) * n)))
+	fatal_error("out of memory");
+    for (i = 0; i < n; i++) {
+	order[i].len = len[i];
+	order[i].index = i;
+    }
+    qsort(order, n, sizeof(*order), cs_length_compare);
+
+    for (i = 0; i < n; i += CHARSTRING_LANES) {
+	int gn = (n - i < CHARSTRING_LANES ? n - i : CHARSTRING_LANES);
+	for (k = 0; k < gn; k++) {
+	    gcs[k] = cs[order[i + k].index];
+	    glen[k] = order[i + k].len;
+	}
+	cs_crypt_group(gcs, glen, gn, f);
+    }
+
+    free(order);
+}
+
+/* Decrypt the N charstrings cs[0..N-1], of lengths len[0..N-1], in place.
+   Each charstring starts at CHARSTRING_KEY. This does not skip lenIV bytes;
+   callers that should not decrypt (lenIV < 0) must leave those charstrings
+   out. */
+
+void
+decrypt_charstrings(unsigned char **cs, const int *len, int n)
+{
+    cs_crypt_batch(cs, len, n,
+		   (kernels ? kernels : init_kernels())->cs_decrypt_rows);
+}
+
+/* Encrypt the N charstrings cs[0..N-1] in place. The caller supplies the
+   plaintext lenIV bytes at the start of each charstring. */
+
+void
+encrypt_charstrings(unsigned char **cs, const int *len, int n)
+{
+    cs_crypt_batch(cs, len, n,
+		   (kernels ? kernels : init_kernels())->cs_encrypt_rows);
+}
+
 #ifdef __cplusplus
 }
 #endif
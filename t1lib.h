@@ -46,6 +46,19 @@ void pfb_writer_end(struct pfb_writer *);
 
 int crcbuf(int crc, unsigned int len, const char *buf);
 
+/* Charstring encryption restarts at the same key for every charstring, so
+   independent charstrings can be processed side by side, one per lane. */
+#define CHARSTRING_KEY		4330
+#define CHARSTRING_LANES	16
+
+void decrypt_charstrings(unsigned char **cs, const int *len, int n);
+void encrypt_charstrings(unsigned char **cs, const int *len, int n);
+
+/* Byte kernels are chosen at runtime from the CPU features; the
+   T1UTILS_KERNELS environment variable can force a version. */
+const char *kernel_variant(void);
+void hex_encode(char *dst, const unsigned char *src, int len);
+
 /* whoever uses this code must provide a definition for these functions */
 extern void error(const char *, ...);
 extern void fatal_error(const char *, ...);
@@ -0,0 +1,48 @@
+#ifndef T1RECORDS_H
+#define T1RECORDS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The binary disassembly format, written by `t1disasm --format=binary'.
+
+   A file starts with the T1R_MAGIC bytes, then holds a sequence of
+   records. Each record is a type byte, a 4-byte payload length, and the
+   payload. All integers are big-endian and signed.
+
+   T1R_TEXT	Font text, exactly as the text format would print it, but
+		without charstrings. A charstring record goes where its
+		`{ ... }' would have been.
+   T1R_CHARSTRING
+		A decoded charstring:
+		  4 bytes	Subr number, or -1 for a CharStrings entry
+		  2 bytes	glyph name length, 0 for a Subr
+		  n bytes	glyph name, without the `/'
+		  1 byte	flags (T1R_TRUNCATED)
+		  4 bytes	number of operators, nops
+		  4 bytes	number of operands, nargs
+		  4*(nops+1)	argstart array (see struct t1cs_ir)
+		  2*nops	operator opcodes (see T1CS_OPCODE)
+		  4*nargs	operands
+   T1R_END	End of file, with an empty payload. */
+
+#define T1R_MAGIC	"T1DB\0\0\0\1"
+#define T1R_MAGIC_LEN	8
+
+#define T1R_TEXT	'T'
+#define T1R_CHARSTRING	'C'
+#define T1R_END		'E'
+
+#define T1R_HEADER_LEN	5
+
+#define T1R_TRUNCATED	0x01	/* charstring ended mid-token */
+
+/* bytes in a charstring record's payload */
+#define T1R_CHARSTRING_LEN(namelen, nops, nargs) \
+  (4 + 2 + (namelen) + 1 + 4 + 4 + 4 * ((nops) + 1) + 2 * (nops) \
+   + 4 * (nargs))
+
+#ifdef __cplusplus
+}
+#endif
+#endif
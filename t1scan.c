@@ -0,0 +1,516 @@
+/* t1scan
+ *
+ * This file contains an incremental PostScript tokenizer for the cleartext
+ * and eexec portions of Type 1 fonts.
+ *
+ * Copyright (c) 1998-2017 Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, subject to the
+ * conditions listed in the Click LICENSE file, which is available in full at
+ * http://github.com/kohler/click/blob/master/LICENSE. The conditions
+ * include: you must preserve this copyright notice, and you cannot mention
+ * the copyright holders in advertising related to the Software without
+ * their permission. The Software is provided WITHOUT ANY WARRANTY, EXPRESS
+ * OR IMPLIED. This notice is a summary of the Click LICENSE file; the
+ * license in that file is binding.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include "t1lib.h"
+#include "t1scan.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define S_SPACE		0
+#define S_REGULAR	1
+#define S_STRING	2
+#define S_HEX		3
+#define S_COMMENT	4
+#define S_LESS		5	/* after `<' */
+#define S_GREATER	6	/* after `>' */
+#define S_BINARY	7
+
+#define is_ps_space(c)	((c) == ' ' || (c) == '\t' || (c) == '\n' \
+			 || (c) == '\r' || (c) == '\f' || (c) == 0)
+#define is_ps_delim(c)	((c) == '(' || (c) == ')' || (c) == '<' || (c) == '>' \
+			 || (c) == '[' || (c) == ']' || (c) == '{' \
+			 || (c) == '}' || (c) == '/' || (c) == '%')
+
+const struct t1scan_key t1scan_keys[T1K_NKEYS] = {
+    { "FontName", T1K_TYPE_NAME },
+    { "FamilyName", T1K_TYPE_STRING },
+    { "FullName", T1K_TYPE_STRING },
+    { "Weight", T1K_TYPE_STRING },
+    { "ItalicAngle", T1K_TYPE_NUMBER },
+    { "FontBBox", T1K_TYPE_ARRAY },
+    { "UniqueID", T1K_TYPE_NUMBER },
+    { "Encoding", T1K_TYPE_NAME },
+    { "lenIV", T1K_TYPE_NUMBER },
+    { "BlueValues", T1K_TYPE_ARRAY },
+    { "OtherBlues", T1K_TYPE_ARRAY },
+    { "StdHW", T1K_TYPE_ARRAY },
+    { "StdVW", T1K_TYPE_ARRAY },
+    { "Subrs", T1K_TYPE_NUMBER },
+    { "CharStrings", T1K_TYPE_NUMBER }
+};
+
+void
+t1scan_init(struct t1scan *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->lenIV = 4;
+    s->nsubrs = s->ncharstrings = -1;
+    s->state = S_SPACE;
+    s->pending_key = s->array_key = -1;
+}
+
+void
+t1scan_clear(struct t1scan *s)
+{
+    int i;
+    for (i = 0; i < T1K_NKEYS; i++) {
+	free(s->value[i]);
+	s->value[i] = 0;
+    }
+}
+
+
+/*****
+ * Font state
+ **/
+
+static void
+set_value(struct t1scan *s, int key, const char *text, int len)
+{
+    char *v = (char *) malloc(len + 1);
+    if (!v)
+	fatal_error("out of memory");
+    memcpy(v, text, len);
+    v[len] = 0;
+    free(s->value[key]);
+    s->value[key] = v;
+}
+
+static void
+append_array_value(struct t1scan *s, int key, const char *text, int len)
+{
+    char *old = s->value[key];
+    int old_len = strlen(old);
+    char *v = (char *) malloc(old_len + len + 2);
+    if (!v)
+	fatal_error("out of memory");
+    memcpy(v, old, old_len);
+    if (old_len)
+	v[old_len++] = ' ';
+    memcpy(v + old_len, text, len);
+    v[old_len + len] = 0;
+    free(old);
+    s->value[key] = v;
+}
+
+static int
+find_key(const char *name)
+{
+    int i;
+    for (i = 0; i < T1K_NKEYS; i++)
+	if (strcmp(t1scan_keys[i].name, name) == 0)
+	    return i;
+    return -1;
+}
+
+static void
+event(struct t1scan *s, int ev, int pos)
+{
+    s->events |= ev;
+    s->event_pos = pos;
+    if (s->stop_events & ev)
+	s->stopped = 1;
+}
+
+/* This function updates the font state with one token. `pos' is the offset
+   just after the token in the text being fed. */
+
+static void
+font_token(struct t1scan *s, int kind, const char *tok, int len, int pos)
+{
+    int k;
+
+    /* `/CharStrings N dict dup begin' */
+    if (s->charstrings_begin) {
+	static const char * const words[] = { "dict", "dup", "begin" };
+	if (kind == T1TOK_NAME
+	    && strcmp(tok, words[s->charstrings_begin - 1]) == 0) {
+	    if (++s->charstrings_begin == 4) {
+		s->charstrings_begin = 0;
+		event(s, T1SCAN_EV_CHARSTRINGS_BEGIN, pos);
+	    }
+	} else
+	    s->charstrings_begin = 0;
+    }
+
+    /* collecting an array value like `[-20 0 450 470]' or `{0 0 100 100}' */
+    if (s->array_key >= 0) {
+	if (kind == T1TOK_NUMBER)
+	    append_array_value(s, s->array_key, tok, len);
+	else if (kind == T1TOK_ARRAY_END || kind == T1TOK_PROC_END)
+	    s->array_key = -1;
+	goto out;
+    }
+
+    /* the value of a key we care about */
+    if (s->pending_key >= 0) {
+	k = s->pending_key;
+	s->pending_key = -1;
+	if (t1scan_keys[k].type == T1K_TYPE_ARRAY
+	    && (kind == T1TOK_ARRAY_BEGIN || kind == T1TOK_PROC_BEGIN)) {
+	    set_value(s, k, "", 0);
+	    s->array_key = k;
+	    goto out;
+	} else if (k == T1K_ENCODING && kind == T1TOK_NUMBER) {
+	    /* `/Encoding 256 array' starts a custom encoding */
+	    set_value(s, k, "custom", 6);
+	    s->encoding_entries = 0;
+	    s->counting_encoding = 1;
+	    goto out;
+	} else if (kind == T1TOK_NUMBER || kind == T1TOK_STRING
+		   || kind == T1TOK_LITERAL || kind == T1TOK_NAME) {
+	    set_value(s, k, tok, len);
+	    if (k == T1K_LENIV && kind == T1TOK_NUMBER)
+		s->lenIV = (int) strtol(tok, 0, 10);
+	    else if (k == T1K_SUBRS && kind == T1TOK_NUMBER) {
+		s->nsubrs = (int) strtol(tok, 0, 10);
+		event(s, T1SCAN_EV_SUBRS, pos);
+	    } else if (k == T1K_CHARSTRINGS && kind == T1TOK_NUMBER) {
+		s->ncharstrings = (int) strtol(tok, 0, 10);
+		s->charstrings_begin = 1;
+		event(s, T1SCAN_EV_CHARSTRINGS, pos);
+	    }
+	    goto out;
+	}
+    }
+
+    switch (kind) {
+
+      case T1TOK_LITERAL:
+	if (s->brace_depth == 0 && (k = find_key(tok)) >= 0)
+	    s->pending_key = k;
+	memcpy(s->prev_literal, tok, len + 1);
+	break;
+
+      case T1TOK_PROC_BEGIN:
+	if (s->brace_depth++ == 0) {
+	    if (s->prev_kind == T1TOK_LITERAL)
+		memcpy(s->proc_name, s->prev_literal, strlen(s->prev_literal) + 1);
+	    else
+		s->proc_name[0] = 0;
+	    s->readstring_state = 0;
+	}
+	break;
+
+      case T1TOK_PROC_END:
+	if (s->brace_depth > 0)
+	    s->brace_depth--;
+	break;
+
+      case T1TOK_NAME:
+	/* locate the charstring start command, defined by a procedure like
+	   `/RD {string currentfile exch readstring pop} executeonly def' */
+	if (s->brace_depth == 1) {
+	    if (strcmp(tok, "string") == 0)
+		s->readstring_state = 1;
+	    else if (s->readstring_state == 1 && strcmp(tok, "currentfile") == 0)
+		s->readstring_state = 2;
+	    else if (s->readstring_state == 2 && strcmp(tok, "readstring") == 0
+		     && s->proc_name[0]) {
+		memcpy(s->cs_start, s->proc_name, strlen(s->proc_name) + 1);
+		event(s, T1SCAN_EV_CS_START, pos);
+	    } else if (s->readstring_state == 1)
+		s->readstring_state = 0;
+	} else if (s->brace_depth == 0) {
+	    if (s->prev_currentfile && strcmp(tok, "closefile") == 0)
+		event(s, T1SCAN_EV_CLOSEFILE, pos);
+	    /* skip binary charstring data after `NUM RD ' */
+	    else if (s->skip_binary && s->cs_start[0]
+		     && s->prev_kind == T1TOK_NUMBER && s->prev_number > 0
+		     && strcmp(tok, s->cs_start) == 0) {
+		s->skip = s->prev_number;
+		s->binary_subr = (s->prev2_kind == T1TOK_NUMBER
+				  ? s->prev2_number : -1);
+		if (s->prev2_kind == T1TOK_LITERAL)
+		    memcpy(s->binary_name, s->prev_literal,
+			   strlen(s->prev_literal) + 1);
+		else
+		    s->binary_name[0] = 0;
+		event(s, T1SCAN_EV_BINARY, pos);
+	    }
+	    else if (s->counting_encoding && strcmp(tok, "put") == 0)
+		s->encoding_entries++;
+	    else if (s->counting_encoding && strcmp(tok, "def") == 0)
+		s->counting_encoding = 0;
+	}
+	break;
+
+    }
+
+  out:
+    s->prev2_kind = s->prev_kind;
+    s->prev2_number = s->prev_number;
+    s->prev_kind = kind;
+    s->prev_currentfile = (kind == T1TOK_NAME && strcmp(tok, "currentfile") == 0);
+    if (kind == T1TOK_NUMBER)
+	s->prev_number = strtol(tok, 0, 10);
+}
+
+
+/*****
+ * Tokenizer
+ **/
+
+/* This function returns 1 if the token looks like a PostScript number:
+   an integer, a real, or a radix number like 16#FF. */
+
+static int
+is_ps_number(const char *s, int len)
+{
+    const char *end = s + len;
+    int digits = 0;
+    if (s < end && (*s == '+' || *s == '-'))
+	s++;
+    for (; s < end && isdigit((unsigned char) *s); s++)
+	digits++;
+    if (s < end && *s == '#' && digits)
+	return s + 1 < end;
+    if (s < end && *s == '.')
+	for (s++; s < end && isdigit((unsigned char) *s); s++)
+	    digits++;
+    if (!digits)
+	return 0;
+    if (s < end && (*s == 'e' || *s == 'E')) {
+	s++;
+	if (s < end && (*s == '+' || *s == '-'))
+	    s++;
+	if (s == end || !isdigit((unsigned char) *s))
+	    return 0;
+	while (s < end && isdigit((unsigned char) *s))
+	    s++;
+    }
+    return s == end;
+}
+
+static void
+append(struct t1scan *s, int c)
+{
+    if (s->len < T1SCAN_TOKLEN)
+	s->tok[s->len++] = c;
+}
+
+static void
+emit(struct t1scan *s, int kind, int pos)
+{
+    s->tok[s->len] = 0;
+    font_token(s, kind, s->tok, s->len, pos);
+    s->len = 0;
+}
+
+static void
+emit_regular(struct t1scan *s, int pos)
+{
+    if (s->kind == T1TOK_LITERAL)
+	emit(s, T1TOK_LITERAL, pos);
+    else
+	emit(s, is_ps_number(s->tok, s->len) ? T1TOK_NUMBER : T1TOK_NAME, pos);
+}
+
+/* This function handles one character of a (string), including escapes. */
+
+static void
+string_char(struct t1scan *s, int c, int pos)
+{
+    if (s->escape == 1) {
+	s->escape = 0;
+	if (c >= '0' && c <= '7') {
+	    s->escape = 2;
+	    s->octal = c - '0';
+	} else if (c == 'n')
+	    append(s, '\n');
+	else if (c == 'r')
+	    append(s, '\r');
+	else if (c == 't')
+	    append(s, '\t');
+	else if (c == 'b')
+	    append(s, '\b');
+	else if (c == 'f')
+	    append(s, '\f');
+	else if (c != '\n' && c != '\r') /* backslash-newline continues */
+	    append(s, c);
+	return;
+    } else if (s->escape >= 2) {
+	if (c >= '0' && c <= '7' && s->escape < 4) {
+	    s->octal = s->octal * 8 + c - '0';
+	    s->escape++;
+	    return;
+	}
+	append(s, s->octal & 0xFF);
+	s->escape = 0;
+    }
+
+    if (c == '\\')
+	s->escape = 1;
+    else if (c == '(') {
+	s->paren_depth++;
+	append(s, c);
+    } else if (c == ')' && --s->paren_depth == 0) {
+	emit(s, T1TOK_STRING, pos);
+	s->state = S_SPACE;
+    } else
+	append(s, c);
+}
+
+/* This function scans `len' bytes of text and returns the number consumed,
+   which is less than `len' only if a stop event occurred. */
+
+int
+t1scan_feed(struct t1scan *s, const unsigned char *data, int len)
+{
+    const unsigned char *start = data;
+    const unsigned char *end = data + len;
+
+    while (data < end && !s->stopped) {
+	int c = *data;
+
+	switch (s->state) {
+
+	  case S_BINARY:
+	    if (end - data >= s->skip) {
+		data += s->skip;
+		s->skip = 0;
+		s->state = S_SPACE;
+	    } else {
+		s->skip -= end - data;
+		data = end;
+	    }
+	    continue;
+
+	  case S_COMMENT:
+	    if (c == '\n' || c == '\r')
+		s->state = S_SPACE;
+	    data++;
+	    continue;
+
+	  case S_STRING:
+	    data++;
+	    string_char(s, c, data - start);
+	    continue;
+
+	  case S_HEX:
+	    data++;
+	    if (c == '>') {
+		emit(s, T1TOK_HEXSTRING, data - start);
+		s->state = S_SPACE;
+	    } else if (isxdigit(c))
+		append(s, c);
+	    continue;
+
+	  case S_LESS:
+	    if (c == '<') {
+		data++;
+		emit(s, T1TOK_DICT_BEGIN, data - start);
+		s->state = S_SPACE;
+	    } else
+		s->state = S_HEX;
+	    continue;
+
+	  case S_GREATER:
+	    s->state = S_SPACE;
+	    if (c == '>') {
+		data++;
+		emit(s, T1TOK_DICT_END, data - start);
+	    }
+	    continue;
+
+	  case S_REGULAR:
+	    if (is_ps_space(c)) {
+		emit_regular(s, data - start);
+		/* binary data to skip starts after this space */
+		s->state = (s->skip > 0 ? S_BINARY : S_SPACE);
+		data++;
+	    } else if (is_ps_delim(c)) {
+		if (c == '/' && s->kind == T1TOK_LITERAL && s->len == 0)
+		    data++;	/* immediately evaluated name `//name' */
+		else {
+		    emit_regular(s, data - start);
+		    s->skip = 0;
+		    s->state = S_SPACE;
+		}
+	    } else {
+		append(s, c);
+		data++;
+	    }
+	    continue;
+
+	  case S_SPACE:
+	  default:
+	    data++;
+	    if (is_ps_space(c))
+		/* nada */;
+	    else if (c == '%')
+		s->state = S_COMMENT;
+	    else if (c == '(') {
+		s->state = S_STRING;
+		s->paren_depth = 1;
+		s->escape = 0;
+	    } else if (c == '<')
+		s->state = S_LESS;
+	    else if (c == '>')
+		s->state = S_GREATER;
+	    else if (c == '{')
+		emit(s, T1TOK_PROC_BEGIN, data - start);
+	    else if (c == '}')
+		emit(s, T1TOK_PROC_END, data - start);
+	    else if (c == '[')
+		emit(s, T1TOK_ARRAY_BEGIN, data - start);
+	    else if (c == ']')
+		emit(s, T1TOK_ARRAY_END, data - start);
+	    else if (c == ')')
+		/* stray close paren: ignore */;
+	    else if (c == '/') {
+		s->state = S_REGULAR;
+		s->kind = T1TOK_LITERAL;
+	    } else {
+		s->state = S_REGULAR;
+		s->kind = T1TOK_NAME;
+		append(s, c);
+	    }
+	    continue;
+
+	}
+    }
+
+    s->stopped = 0;
+    return data - start;
+}
+
+/* This function finishes any token in progress at the end of input. */
+
+void
+t1scan_end(struct t1scan *s)
+{
+    if (s->state == S_REGULAR)
+	emit_regular(s, 0);
+    s->state = S_SPACE;
+    s->skip = 0;
+    s->stopped = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+#ifndef T1SCAN_H
+#define T1SCAN_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An incremental PostScript tokenizer for the cleartext and eexec parts of
+   Type 1 fonts. Feed it text in pieces of any size. As it goes, it records
+   the keys a Type 1 tool cares about (the font names, the Private values,
+   the charstring start command, the sizes of Subrs and CharStrings) as
+   structured state, so callers never rescan lines. */
+
+#define T1TOK_NAME		1	/* executable name, like `def' */
+#define T1TOK_LITERAL		2	/* literal name, without the `/' */
+#define T1TOK_NUMBER		3
+#define T1TOK_STRING		4	/* (string), unescaped */
+#define T1TOK_HEXSTRING		5	/* <hex string>, digits only */
+#define T1TOK_PROC_BEGIN	6	/* { */
+#define T1TOK_PROC_END		7	/* } */
+#define T1TOK_ARRAY_BEGIN	8	/* [ */
+#define T1TOK_ARRAY_END		9	/* ] */
+#define T1TOK_DICT_BEGIN	10	/* << */
+#define T1TOK_DICT_END		11	/* >> */
+
+/* Recognized keys. Values are kept as text; array values hold their
+   elements separated by single spaces. */
+#define T1K_FONTNAME		0
+#define T1K_FAMILYNAME		1
+#define T1K_FULLNAME		2
+#define T1K_WEIGHT		3
+#define T1K_ITALICANGLE		4
+#define T1K_FONTBBOX		5
+#define T1K_UNIQUEID		6
+#define T1K_ENCODING		7	/* encoding name, or "custom" */
+#define T1K_LENIV		8
+#define T1K_BLUEVALUES		9
+#define T1K_OTHERBLUES		10
+#define T1K_STDHW		11
+#define T1K_STDVW		12
+#define T1K_SUBRS		13	/* number of Subrs */
+#define T1K_CHARSTRINGS		14	/* number of glyphs */
+#define T1K_NKEYS		15
+
+#define T1K_TYPE_NAME		0
+#define T1K_TYPE_STRING		1
+#define T1K_TYPE_NUMBER		2
+#define T1K_TYPE_ARRAY		3
+
+struct t1scan_key {
+  const char *name;
+  int type;
+};
+
+extern const struct t1scan_key t1scan_keys[T1K_NKEYS];
+
+/* Events, or'ed into `events' as they are seen. Callers clear `events'
+   themselves. If an event is also in `stop_events', t1scan_feed returns
+   right after the token that caused it. */
+#define T1SCAN_EV_SUBRS		0x01	/* `/Subrs N' */
+#define T1SCAN_EV_CHARSTRINGS	0x02	/* `/CharStrings N' */
+#define T1SCAN_EV_CHARSTRINGS_BEGIN 0x04 /* `/CharStrings N dict dup begin' */
+#define T1SCAN_EV_CLOSEFILE	0x08	/* `currentfile closefile' */
+#define T1SCAN_EV_CS_START	0x10	/* charstring start command defined */
+#define T1SCAN_EV_BINARY	0x20	/* binary data after `NUM RD ' follows;
+					   needs skip_binary */
+
+/* longer tokens are truncated */
+#define T1SCAN_TOKLEN		256
+
+struct t1scan {
+  /* font state */
+  char *value[T1K_NKEYS];       /* null if not defined */
+  int lenIV;                    /* 4 unless the font says otherwise */
+  int nsubrs;                   /* -1 until seen */
+  int ncharstrings;             /* -1 until seen */
+  int encoding_entries;         /* `put's into a custom Encoding */
+  char cs_start[T1SCAN_TOKLEN + 1]; /* charstring start command, like RD */
+
+  int events;
+  int stop_events;
+  int event_pos;                /* offset in the fed text just after the
+                                   token causing the latest event */
+  int stopped;
+
+  /* If skip_binary is set, binary data after `NUM RD ' is skipped, as
+     PostScript's readstring would. `skip' bytes remain to be skipped. On
+     T1SCAN_EV_BINARY, binary_subr is the number before `NUM' (the Subr
+     index in `dup 5 NUM RD '), or -1; binary_name is the literal name
+     before `NUM', without the `/', or empty. */
+  int skip_binary;
+  long skip;
+  long binary_subr;
+  char binary_name[T1SCAN_TOKLEN + 1];
+
+  /* tokenizer state */
+  int state;
+  int paren_depth;
+  int escape;
+  int octal;
+  int kind;
+  int len;
+  char tok[T1SCAN_TOKLEN + 1];
+
+  /* parser state */
+  int brace_depth;
+  int pending_key;
+  int array_key;
+  int counting_encoding;
+  int charstrings_begin;
+  int prev_kind;
+  long prev_number;
+  int prev2_kind;               /* the token before the previous one */
+  long prev2_number;
+  int prev_currentfile;
+  int readstring_state;
+  char prev_literal[T1SCAN_TOKLEN + 1];
+  char proc_name[T1SCAN_TOKLEN + 1];
+};
+
+void t1scan_init(struct t1scan *);
+int t1scan_feed(struct t1scan *, const unsigned char *data, int len);
+void t1scan_end(struct t1scan *);
+void t1scan_clear(struct t1scan *);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,718 @@
+/* t1subrs
+ *
+ * This file contains passes over all of a Type 1 font's decoded
+ * charstrings at once, which add, inline or remove Subrs.
+ *
+ * Copyright (c) 1998-2017 Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, subject to the
+ * conditions listed in the Click LICENSE file, which is available in full at
+ * http://github.com/kohler/click/blob/master/LICENSE. The conditions
+ * include: you must preserve this copyright notice, and you cannot mention
+ * the copyright holders in advertising related to the Software without
+ * their permission. The Software is provided WITHOUT ANY WARRANTY, EXPRESS
+ * OR IMPLIED. This notice is a summary of the Click LICENSE file; the
+ * license in that file is binding.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "t1lib.h"
+#include "t1cs.h"
+#include "t1subrs.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static void *
+xmalloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (!p)
+	fatal_error("out of memory");
+    return p;
+}
+
+static int
+add_subr(struct t1cs_font *font, struct t1cs_ir *ir)
+{
+    if (font->nsubrs == font->subrs_cap) {
+	font->subrs_cap = (font->subrs_cap ? 2 * font->subrs_cap : 64);
+	font->subrs = (struct t1cs_ir **)
+	    realloc(font->subrs, font->subrs_cap * sizeof(struct t1cs_ir *));
+	if (!font->subrs)
+	    fatal_error("out of memory");
+    }
+    font->subrs[font->nsubrs] = ir;
+    return font->nsubrs++;
+}
+
+static int
+int_len(int32_t num)
+{
+    if (num >= -107 && num <= 107)
+	return 1;
+    else if (num >= -1131 && num <= 1131)
+	return 2;
+    else
+	return 5;
+}
+
+
+
+/*****
+ * Subroutinization
+ **/
+
+/* A unit is an operator with its operands. Glyphs become one sequence of
+   symbols, one per unit. Units that may move into a Subr -- path
+   operators with all their operands, outside flex -- get the same symbol
+   when they are equal. Every other unit, and the end of each glyph, gets a
+   symbol of its own, so no repeat spans it. A suffix array over the
+   sequence finds the repeats. */
+
+static int
+movable(int opcode)
+{
+    switch (opcode) {
+      case CS_rlineto: case CS_hlineto: case CS_vlineto:
+      case CS_rrcurveto: case CS_hvcurveto: case CS_vhcurveto:
+      case CS_rmoveto: case CS_hmoveto: case CS_vmoveto:
+      case CS_closepath:
+	return 1;
+      default:
+	return 0;
+    }
+}
+
+static uint32_t
+unit_hash(const struct t1cs_ir *ir, int i)
+{
+    uint32_t h = 2166136261U ^ ir->ops[i];
+    int a;
+    for (a = ir->argstart[i]; a < ir->argstart[i + 1]; a++)
+	h = (h ^ (uint32_t) ir->args[a]) * 16777619U;
+    return h;
+}
+
+static int
+unit_equal(const struct t1cs_ir *ir1, int i1, const struct t1cs_ir *ir2,
+	   int i2)
+{
+    int n = ir1->argstart[i1 + 1] - ir1->argstart[i1];
+    return ir1->ops[i1] == ir2->ops[i2]
+	&& ir2->argstart[i2 + 1] - ir2->argstart[i2] == n
+	&& memcmp(ir1->args + ir1->argstart[i1], ir2->args + ir2->argstart[i2],
+		  n * sizeof(int32_t)) == 0;
+}
+
+/* Sorts the suffixes of seq[0...n-1], whose symbols are less than nsym, by
+   prefix doubling with counting sorts. */
+
+static void
+suffix_array(const int *seq, int n, int nsym, int *sa)
+{
+    int *rank = (int *) xmalloc(n * sizeof(int));
+    int *tmp = (int *) xmalloc(n * sizeof(int));
+    int range = (nsym > n ? nsym : n) + 1;
+    int *count = (int *) xmalloc((range + 1) * sizeof(int));
+    int i, j, k;
+
+    for (i = 0; i < n; i++)
+	rank[i] = seq[i];
+    for (k = 1; ; k *= 2) {
+	/* by the second half, then stably by the first */
+	memset(count, 0, (range + 1) * sizeof(int));
+	for (i = 0; i < n; i++)
+	    count[i + k < n ? rank[i + k] + 1 : 0]++;
+	for (j = 1; j <= range; j++)
+	    count[j] += count[j - 1];
+	for (i = n - 1; i >= 0; i--)
+	    tmp[--count[i + k < n ? rank[i + k] + 1 : 0]] = i;
+	memset(count, 0, (range + 1) * sizeof(int));
+	for (i = 0; i < n; i++)
+	    count[rank[i]]++;
+	for (j = 1; j <= range; j++)
+	    count[j] += count[j - 1];
+	for (j = n - 1; j >= 0; j--)
+	    sa[--count[rank[tmp[j]]]] = tmp[j];
+
+	tmp[sa[0]] = 0;
+	for (j = 1; j < n; j++) {
+	    int a = sa[j - 1], b = sa[j];
+	    tmp[b] = tmp[a] + (rank[a] != rank[b]
+			       || (a + k < n ? rank[a + k] : -1)
+			       != (b + k < n ? rank[b + k] : -1));
+	}
+	memcpy(rank, tmp, n * sizeof(int));
+	if (n == 0 || rank[sa[n - 1]] == n - 1)
+	    break;
+    }
+
+    free(rank);
+    free(tmp);
+    free(count);
+}
+
+struct lcp_interval {
+    int lcp;
+    int lb;
+};
+
+struct candidate {
+    int lb;			/* suffix array range */
+    int rb;
+    int len;			/* in units */
+    int bytes;
+    int saving;			/* estimated */
+};
+
+static int CDECL
+candidate_compare(const void *a, const void *b)
+{
+    const struct candidate *ca = (const struct candidate *) a;
+    const struct candidate *cb = (const struct candidate *) b;
+    if (ca->saving != cb->saving)
+	return (ca->saving > cb->saving ? -1 : 1);
+    return ca->lb - cb->lb;
+}
+
+static int CDECL
+int_compare(const void *a, const void *b)
+{
+    int ia = *(const int *) a, ib = *(const int *) b;
+    return (ia < ib ? -1 : ia > ib);
+}
+
+int
+t1cs_subroutinize(struct t1cs_font *font)
+{
+    int n, nsym, nunits, ncand, nadded = 0;
+    int g, i, j, p;
+    int *seq, *sa, *lcp, *glyph_of, *glyph_pos, *bytesum, *subr_at, *occ;
+    int *table, table_size;
+    struct candidate *cand;
+    struct lcp_interval *stack;
+    int nstack;
+
+    /* number the positions; glyph g starts at glyph_pos[g] */
+    glyph_pos = (int *) xmalloc((font->nglyphs + 1) * sizeof(int));
+    for (g = n = 0; g < font->nglyphs; g++) {
+	glyph_pos[g] = n;
+	n += font->glyphs[g]->nops + 1;
+    }
+    glyph_pos[g] = n;
+    seq = (int *) xmalloc(n * sizeof(int));
+    glyph_of = (int *) xmalloc(n * sizeof(int));
+    bytesum = (int *) xmalloc((n + 1) * sizeof(int));
+    for (table_size = 1; table_size < 2 * n; table_size *= 2)
+	/* nada */;
+    table = (int *) xmalloc(table_size * sizeof(int));
+    memset(table, 0, table_size * sizeof(int));
+
+    /* intern the movable units; the others get symbols after them */
+    nunits = bytesum[0] = 0;
+    for (g = p = 0; g < font->nglyphs; g++) {
+	struct t1cs_ir *ir = font->glyphs[g];
+	int stack_empty = 1, in_flex = 0, ra = 0;
+	for (i = 0; i <= ir->nops; i++, p++) {
+	    int end = (i < ir->nops ? ir->argstart[i + 1] : 0);
+	    const struct t1cs_op *op = (i < ir->nops ? t1cs_decode(ir->ops[i])
+					: 0);
+	    glyph_of[p] = g;
+	    bytesum[p + 1] = 0;
+	    if (op && stack_empty && !in_flex && movable(ir->ops[i])
+		&& end - ra == op->args1) {
+		uint32_t h = unit_hash(ir, i) & (table_size - 1);
+		while (table[h]) {
+		    int q = table[h] - 1;
+		    if (unit_equal(font->glyphs[glyph_of[q]],
+				   q - glyph_pos[glyph_of[q]], ir, i))
+			break;
+		    h = (h + 1) & (table_size - 1);
+		}
+		if (!table[h]) {
+		    table[h] = p + 1;
+		    seq[p] = nunits++;
+		} else
+		    seq[p] = seq[table[h] - 1];
+		bytesum[p + 1] = t1cs_op_len(ir, i);
+	    } else
+		seq[p] = -1;
+	    if (i < ir->nops) {
+		if (ir->ops[i] == CS_callothersubr && end > ra) {
+		    if (ir->args[end - 1] == 1)
+			in_flex = 1;
+		    else if (ir->args[end - 1] == 0)
+			in_flex = 0;
+		}
+		stack_empty = t1cs_clears_stack(ir->ops[i]);
+		ra = end;
+	    }
+	}
+    }
+    free(table);
+    for (p = 0; p < n; p++)
+	bytesum[p + 1] += bytesum[p];
+    for (p = 0, nsym = nunits; p < n; p++)
+	if (seq[p] < 0)
+	    seq[p] = nsym++;
+
+    /* Kasai's algorithm: lcp[j] is the common prefix of suffixes sa[j-1]
+       and sa[j] */
+    sa = (int *) xmalloc(n * sizeof(int));
+    suffix_array(seq, n, nsym, sa);
+    lcp = (int *) xmalloc((n + 1) * sizeof(int));
+    {
+	int *rank = (int *) xmalloc(n * sizeof(int)), h = 0;
+	for (j = 0; j < n; j++)
+	    rank[sa[j]] = j;
+	for (p = 0; p < n; p++)
+	    if (rank[p] > 0) {
+		int q = sa[rank[p] - 1];
+		while (p + h < n && q + h < n && seq[p + h] == seq[q + h])
+		    h++;
+		lcp[rank[p]] = h;
+		if (h > 0)
+		    h--;
+	    } else
+		h = 0;
+	free(rank);
+    }
+    lcp[0] = lcp[n] = 0;
+
+    /* Each LCP interval is a repeat; estimate what moving it into a Subr
+       would save. */
+    cand = (struct candidate *) xmalloc(n * sizeof(struct candidate));
+    stack = (struct lcp_interval *)
+	xmalloc((n + 1) * sizeof(struct lcp_interval));
+    ncand = nstack = 0;
+    stack[nstack].lcp = 0;
+    stack[nstack++].lb = 0;
+    for (j = 1; j <= n; j++) {
+	int lb = j - 1;
+	while (lcp[j] < stack[nstack - 1].lcp) {
+	    struct candidate *c = &cand[ncand];
+	    nstack--;
+	    c->lb = lb = stack[nstack].lb;
+	    c->rb = j - 1;
+	    c->len = stack[nstack].lcp;
+	    c->bytes = bytesum[sa[lb] + c->len] - bytesum[sa[lb]];
+	    c->saving = (c->rb - c->lb + 1) * (c->bytes - 3)
+		- (c->bytes + 1 + font->subr_overhead);
+	    if (c->saving > 0)
+		ncand++;
+	}
+	if (lcp[j] > stack[nstack - 1].lcp) {
+	    stack[nstack].lcp = lcp[j];
+	    stack[nstack++].lb = lb;
+	}
+    }
+    free(stack);
+    free(lcp);
+    qsort(cand, ncand, sizeof(struct candidate), candidate_compare);
+
+    /* Take the best repeats first. An occurrence is usable if no unit in it
+       moved already. */
+    subr_at = (int *) xmalloc(n * sizeof(int));
+    for (p = 0; p < n; p++)
+	subr_at[p] = -1;
+    occ = (int *) xmalloc(n * sizeof(int));
+    for (j = 0; j < ncand; j++) {
+	struct candidate *c = &cand[j];
+	int nocc = 0, last_end = 0, call, k;
+	memcpy(occ, sa + c->lb, (c->rb - c->lb + 1) * sizeof(int));
+	qsort(occ, c->rb - c->lb + 1, sizeof(int), int_compare);
+	for (i = 0; i <= c->rb - c->lb; i++) {
+	    p = occ[i];
+	    if (p < last_end)
+		continue;
+	    for (k = 0; k < c->len && subr_at[p + k] == -1; k++)
+		/* nada */;
+	    if (k == c->len) {
+		occ[nocc++] = p;
+		last_end = p + c->len;
+	    }
+	}
+	call = int_len(font->nsubrs) + 1;
+	if (nocc * (c->bytes - call) - (c->bytes + 1 + font->subr_overhead) <= 0)
+	    continue;
+
+	/* the new Subr is the units, then `return' */
+	{
+	    struct t1cs_ir *glyph = font->glyphs[glyph_of[occ[0]]], *subr;
+	    int first = occ[0] - glyph_pos[glyph_of[occ[0]]], s;
+	    subr = t1cs_ir_new(c->len + 1
+			       + glyph->argstart[first + c->len]
+			       - glyph->argstart[first]);
+	    for (i = first; i < first + c->len; i++) {
+		int a;
+		for (a = glyph->argstart[i]; a < glyph->argstart[i + 1]; a++)
+		    t1cs_ir_add_arg(subr, glyph->args[a]);
+		t1cs_ir_add_op(subr, glyph->ops[i]);
+	    }
+	    t1cs_ir_add_op(subr, CS_return);
+	    s = add_subr(font, subr);
+	    for (i = 0; i < nocc; i++) {
+		subr_at[occ[i]] = s;
+		for (k = 1; k < c->len; k++)
+		    subr_at[occ[i] + k] = -2;
+	    }
+	    nadded++;
+	}
+    }
+    free(occ);
+    free(cand);
+
+    /* rewrite the glyphs */
+    for (g = p = 0; nadded && g < font->nglyphs; g++) {
+	struct t1cs_ir *ir = font->glyphs[g], *out;
+	for (i = 0; i < ir->nops && subr_at[p + i] == -1; i++)
+	    /* nada */;
+	if (i == ir->nops) {
+	    p += ir->nops + 1;
+	    continue;
+	}
+	/* each call adds an operand, even where it replaces none */
+	out = t1cs_ir_new(ir->nops + ir->nargs);
+	for (i = 0; i < ir->nops; i++, p++) {
+	    int a;
+	    if (subr_at[p] == -2)
+		continue;
+	    else if (subr_at[p] >= 0) {
+		t1cs_ir_add_arg(out, subr_at[p]);
+		t1cs_ir_add_op(out, CS_callsubr);
+		continue;
+	    }
+	    for (a = ir->argstart[i]; a < ir->argstart[i + 1]; a++)
+		t1cs_ir_add_arg(out, ir->args[a]);
+	    t1cs_ir_add_op(out, ir->ops[i]);
+	}
+	for (i = ir->argstart[ir->nops]; i < ir->nargs; i++)
+	    t1cs_ir_add_arg(out, ir->args[i]);
+	out->truncated = ir->truncated;
+	p++;
+	free(ir);
+	font->glyphs[g] = out;
+    }
+
+    free(subr_at);
+    free(sa);
+    free(bytesum);
+    free(glyph_pos);
+    free(glyph_of);
+    free(seq);
+    return nadded;
+}
+
+
+
+
+/*****
+ * Flattening
+ **/
+
+struct flattener {
+    struct t1cs_font *font;
+    struct t1cs_ir **flat;	/* Subr with calls inlined, or null if it
+				   can't be inlined */
+    char *state;		/* 0 unvisited, 1 in progress, 2 done */
+    int ninlined;
+};
+
+static struct t1cs_ir *flatten(struct flattener *, struct t1cs_ir *);
+
+/* A Subr can be inlined if its only `return' ends it. */
+
+static int
+inlinable(const struct t1cs_ir *ir)
+{
+    int i;
+    if (ir->truncated || ir->nops == 0 || ir->ops[ir->nops - 1] != CS_return
+	|| ir->nargs != ir->argstart[ir->nops])
+	return 0;
+    for (i = 0; i < ir->nops - 1; i++) {
+	const struct t1cs_op *op = t1cs_decode(ir->ops[i]);
+	if (!op || (op->flags & T1CS_SPECIAL) || ir->ops[i] == CS_return)
+	    return 0;
+    }
+    return 1;
+}
+
+static struct t1cs_ir *
+flat_subr(struct flattener *fl, int n)
+{
+    if (fl->state[n] == 0) {
+	fl->state[n] = 1;
+	if (fl->font->subrs[n] && inlinable(fl->font->subrs[n]))
+	    fl->flat[n] = flatten(fl, fl->font->subrs[n]);
+	fl->state[n] = 2;
+    }
+    /* a Subr that calls itself is in progress */
+    return (fl->state[n] == 2 ? fl->flat[n] : 0);
+}
+
+/* This function returns the Subr to inline in place of operator i, or
+   -1. Subrs 0-3 implement flex and hint replacement, and stay, as does a
+   Subr like Adobe's Subr 4 that calls the hint set its caller names. */
+
+static int
+inline_target(struct flattener *fl, const struct t1cs_ir *ir, int i)
+{
+    int n;
+    if (ir->ops[i] != CS_callsubr || ir->argstart[i + 1] == ir->argstart[i])
+	return -1;
+    n = ir->args[ir->argstart[i + 1] - 1];
+    if (n < 4 || n >= fl->font->nsubrs || !flat_subr(fl, n)
+	|| t1cs_is_hint_subr(fl->font->subrs[n]))
+	return -1;
+    return n;
+}
+
+/* This function returns `ir' with its calls inlined, or `ir' itself if it
+   has none to inline. An inlined Subr's operands, and any values it
+   returns, join the operands of the neighboring operators. */
+
+static struct t1cs_ir *
+flatten(struct flattener *fl, struct t1cs_ir *ir)
+{
+    struct t1cs_ir *out, *body;
+    int i, j, a, n, nops = ir->nops, nargs = ir->nargs, any = 0;
+
+    for (i = 0; i < ir->nops; i++)
+	if ((n = inline_target(fl, ir, i)) >= 0) {
+	    nops += fl->flat[n]->nops - 2;
+	    nargs += fl->flat[n]->nargs - 1;
+	    any = 1;
+	}
+    if (!any)
+	return ir;
+
+    out = t1cs_ir_new(nops > nargs ? nops : nargs);
+    for (i = 0; i < ir->nops; i++) {
+	if ((n = inline_target(fl, ir, i)) >= 0) {
+	    for (a = ir->argstart[i]; a < ir->argstart[i + 1] - 1; a++)
+		t1cs_ir_add_arg(out, ir->args[a]);
+	    body = fl->flat[n];
+	    for (j = 0; j < body->nops - 1; j++) {
+		for (a = body->argstart[j]; a < body->argstart[j + 1]; a++)
+		    t1cs_ir_add_arg(out, body->args[a]);
+		t1cs_ir_add_op(out, body->ops[j]);
+	    }
+	    for (a = body->argstart[j]; a < body->nargs; a++)
+		t1cs_ir_add_arg(out, body->args[a]);
+	    fl->ninlined++;
+	} else {
+	    for (a = ir->argstart[i]; a < ir->argstart[i + 1]; a++)
+		t1cs_ir_add_arg(out, ir->args[a]);
+	    t1cs_ir_add_op(out, ir->ops[i]);
+	}
+    }
+    for (a = ir->argstart[ir->nops]; a < ir->nargs; a++)
+	t1cs_ir_add_arg(out, ir->args[a]);
+    out->truncated = ir->truncated;
+    return out;
+}
+
+int
+t1cs_flatten(struct t1cs_font *font)
+{
+    struct flattener fl;
+    struct t1cs_ir *ir;
+    int i;
+
+    fl.font = font;
+    fl.flat = (struct t1cs_ir **)
+	xmalloc(font->nsubrs * sizeof(struct t1cs_ir *));
+    fl.state = (char *) xmalloc(font->nsubrs);
+    memset(fl.flat, 0, font->nsubrs * sizeof(struct t1cs_ir *));
+    memset(fl.state, 0, font->nsubrs);
+    fl.ninlined = 0;
+
+    for (i = 0; i < font->nglyphs; i++)
+	if ((ir = flatten(&fl, font->glyphs[i])) != font->glyphs[i]) {
+	    free(font->glyphs[i]);
+	    font->glyphs[i] = ir;
+	}
+    /* Subrs that stay may call others too; their bodies stay out of
+       fl.flat, which only holds bodies to inline */
+    for (i = 0; i < font->nsubrs; i++)
+	if (font->subrs[i] && !flat_subr(&fl, i)
+	    && (ir = flatten(&fl, font->subrs[i])) != font->subrs[i]) {
+	    free(font->subrs[i]);
+	    font->subrs[i] = ir;
+	}
+    for (i = 0; i < font->nsubrs; i++)
+	if (fl.flat[i] && fl.flat[i] != font->subrs[i]) {
+	    free(font->subrs[i]);
+	    font->subrs[i] = fl.flat[i];
+	}
+
+    free(fl.flat);
+    free(fl.state);
+    return fl.ninlined;
+}
+
+
+
+/*****
+ * Subr references
+ **/
+
+/* This function returns 1 if Subr n is a hint replacement Subr, so that
+   `N n callsubr' calls Subr N too. */
+
+static int
+is_hint_subr(const struct t1cs_font *font, int32_t n)
+{
+    return n >= 0 && n < font->nsubrs && font->subrs[n]
+	&& t1cs_is_hint_subr(font->subrs[n]);
+}
+
+static void
+add_work(int n, int **work, int *nwork, int *work_cap)
+{
+    if (*nwork == *work_cap) {
+	*work_cap = (*work_cap ? 2 * *work_cap : 64);
+	if (!(*work = (int *) realloc(*work, *work_cap * sizeof(int))))
+	    fatal_error("out of memory");
+    }
+    (*work)[(*nwork)++] = n;
+}
+
+/* This function adds the Subrs `ir' calls to `work'. It returns 0 if a
+   call's Subr number isn't in the charstring. A hint replacement Subr
+   calls the Subr its callers name. */
+
+static int
+add_calls(const struct t1cs_font *font, const struct t1cs_ir *ir,
+	  int **work, int *nwork, int *work_cap)
+{
+    int i, n, ok = 1;
+    if (t1cs_is_hint_subr(ir))
+	return 1;
+    for (i = 0; i < ir->nops; i++) {
+	int a = ir->argstart[i], end = ir->argstart[i + 1];
+	if (ir->ops[i] == CS_callsubr && end > a) {
+	    n = ir->args[end - 1];
+	    if (is_hint_subr(font, n)) {
+		if (end - a < 2)
+		    ok = 0;
+		else if (ir->args[end - 2] >= 0
+			 && ir->args[end - 2] < font->nsubrs)
+		    add_work(ir->args[end - 2], work, nwork, work_cap);
+	    }
+	} else if (ir->ops[i] == CS_callsubr) {
+	    /* `N 1 3 callothersubr pop callsubr' calls N, found below */
+	    if (i < 2 || ir->ops[i - 1] != CS_pop
+		|| ir->ops[i - 2] != CS_callothersubr
+		|| ir->argstart[i - 1] - ir->argstart[i - 2] < 3
+		|| ir->args[ir->argstart[i - 1] - 1] != 3)
+		ok = 0;
+	    continue;
+	} else if (ir->ops[i] == CS_callothersubr && end - a >= 2
+		   && ir->args[end - 1] == 3 && ir->args[end - 2] == 1) {
+	    if (end - a < 3) {
+		ok = 0;
+		continue;
+	    }
+	    n = ir->args[end - 3];
+	} else
+	    continue;
+	if (n >= 0 && n < font->nsubrs)
+	    add_work(n, work, nwork, work_cap);
+    }
+    return ok;
+}
+
+int
+t1cs_mark_subrs(const struct t1cs_font *font, const struct t1cs_ir *cs,
+		unsigned char *used)
+{
+    int *work = 0, nwork = 0, work_cap = 0, ok;
+
+    ok = add_calls(font, cs, &work, &nwork, &work_cap);
+    while (nwork > 0) {
+	int n = work[--nwork];
+	if (!used[n] && font->subrs[n]) {
+	    used[n] = 1;
+	    if (!add_calls(font, font->subrs[n], &work, &nwork, &work_cap))
+		ok = 0;
+	}
+    }
+    free(work);
+    return ok;
+}
+
+
+
+/*****
+ * Renumbering
+ **/
+
+static void
+renumber(int32_t *n, const int *map, int nmap)
+{
+    if (*n >= 0 && *n < nmap && map[*n] >= 0)
+	*n = map[*n];
+}
+
+void
+t1cs_renumber_calls(const struct t1cs_font *font, struct t1cs_ir *ir,
+		    const int *map)
+{
+    int i;
+    for (i = 0; i < ir->nops; i++) {
+	int a = ir->argstart[i], end = ir->argstart[i + 1];
+	if (ir->ops[i] == CS_callsubr && end > a) {
+	    /* `N S callsubr' with a hint replacement Subr S calls N too */
+	    if (end - a >= 2 && is_hint_subr(font, ir->args[end - 1]))
+		renumber(&ir->args[end - 2], map, font->nsubrs);
+	    renumber(&ir->args[end - 1], map, font->nsubrs);
+	} else if (ir->ops[i] == CS_callothersubr && end - a >= 3
+		   && ir->args[end - 1] == 3 && ir->args[end - 2] == 1)
+	    renumber(&ir->args[end - 3], map, font->nsubrs);
+    }
+}
+
+void
+t1cs_renumber_subrs(struct t1cs_font *font, const int *map)
+{
+    struct t1cs_ir **subrs = (struct t1cs_ir **)
+	xmalloc(font->nsubrs * sizeof(struct t1cs_ir *));
+    int i, n = 0;
+
+    memset(subrs, 0, font->nsubrs * sizeof(struct t1cs_ir *));
+    /* rewrite every call while the Subrs keep their old numbers */
+    for (i = 0; i < font->nglyphs; i++)
+	t1cs_renumber_calls(font, font->glyphs[i], map);
+    for (i = 0; i < font->nsubrs; i++)
+	if (font->subrs[i] && map[i] >= 0)
+	    t1cs_renumber_calls(font, font->subrs[i], map);
+    for (i = 0; i < font->nsubrs; i++)
+	if (!font->subrs[i])
+	    /* nada */;
+	else if (map[i] < 0)
+	    free(font->subrs[i]);
+	else {
+	    subrs[map[i]] = font->subrs[i];
+	    if (map[i] >= n)
+		n = map[i] + 1;
+	}
+
+    free(font->subrs);
+    font->subrs = subrs;
+    font->subrs_cap = font->nsubrs;
+    font->nsubrs = n;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,52 @@
+#ifndef T1SUBRS_H
+#define T1SUBRS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Passes over all of a font's decoded charstrings at once. subrs[i] is
+   Subr i, or null if the font doesn't define it. Charstrings come from
+   t1cs_ir_new; a pass may free and replace them, and may add Subrs at the
+   end. */
+
+struct t1cs_font {
+  struct t1cs_ir **subrs;
+  int nsubrs;
+  int subrs_cap;
+  struct t1cs_ir **glyphs;
+  int nglyphs;
+  int subr_overhead;            /* bytes a Subr costs besides its commands */
+};
+
+/* Moves operator sequences that repeat across glyphs into new Subrs, and
+   calls them instead. Returns the number of Subrs added. */
+int t1cs_subroutinize(struct t1cs_font *);
+
+/* Inlines the Subrs that glyphs and other Subrs call, except Subrs 0-3,
+   which implement flex and hint replacement. A Subr is inlined if its only
+   `return' ends it and the call gives its number. Returns the number of
+   calls inlined. */
+int t1cs_flatten(struct t1cs_font *);
+
+/* Sets used[n] for each Subr n that `cs' can reach, directly, through
+   other Subrs, or by hint replacement (`n 1 3 callothersubr', or `n S
+   callsubr' where Subr S is `1 3 callothersubr pop callsubr return').
+   Returns 0 if a call's Subr number comes from elsewhere, so any Subr might be
+   reached. */
+int t1cs_mark_subrs(const struct t1cs_font *, const struct t1cs_ir *cs,
+		    unsigned char *used);
+
+/* Renumbers Subr n as map[n], or drops it if map[n] is -1, and rewrites
+   the calls and hint replacements that name it. map has nsubrs entries,
+   and no two Subrs may get the same number. */
+void t1cs_renumber_subrs(struct t1cs_font *, const int *map);
+
+/* Rewrites the Subr numbers in one charstring's calls, as above. Call it
+   before t1cs_renumber_subrs, while the font has its old numbering. */
+void t1cs_renumber_calls(const struct t1cs_font *, struct t1cs_ir *,
+			 const int *map);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Checks every byte kernel version that this CPU supports against the
+# scalar algorithms. Versions the CPU lacks are skipped.
+
+status=0
+ran=0
+for k in scalar sse2 ssse3 avx2; do
+    T1UTILS_KERNELS=$k ./test/t1kernels 2>/dev/null
+    case $? in
+    0)  echo "$k: ok"; ran=1;;
+    77) echo "$k: not available";;
+    *)  T1UTILS_KERNELS=$k ./test/t1kernels; status=1;;
+    esac
+done
+test $ran = 1 || status=1
+exit $status
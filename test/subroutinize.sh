@@ -0,0 +1,41 @@
+#!/bin/sh
+# Assembles test fonts with --subroutinize, then inlines the new Subrs
+# again with --flatten-subrs. The result must equal the font assembled
+# as is.
+#
+# closepath.txt: glyphs whose repeated runs are mostly operators without
+# operands, so each new callsubr adds more operands than it replaces.
+#
+# Then flattens fonts whose Subrs already exist. The result must equal
+# the font in the matching -flat.txt file.
+#
+# noreturn.txt: a Subr that ends in endchar rather than return, called
+# through another Subr. It must not be inlined.
+#
+# hintsubr.txt: hint replacement through Adobe's Subr 4 (`N 4 callsubr').
+# Subr 4 must stay, along with the hint sets it reaches.
+
+status=0
+for f in closepath; do
+    if ./t1asm --subroutinize "$srcdir/test/$f.txt" "$f-s.pfb" \
+        && ./t1disasm "$f-s.pfb" "$f-s.raw" \
+        && ./t1asm --flatten-subrs "$f-s.raw" "$f-f.pfb" \
+        && ./t1asm "$srcdir/test/$f.txt" "$f.pfb" \
+        && cmp "$f.pfb" "$f-f.pfb" >/dev/null; then
+        echo "$f: ok"
+    else
+        echo "$f: FAILED"; status=1
+    fi
+    rm -f "$f-s.pfb" "$f-s.raw" "$f-f.pfb" "$f.pfb"
+done
+for f in noreturn hintsubr; do
+    if ./t1asm --flatten-subrs "$srcdir/test/$f.txt" "$f-f.pfb" \
+        && ./t1asm "$srcdir/test/$f-flat.txt" "$f.pfb" \
+        && cmp "$f.pfb" "$f-f.pfb" >/dev/null; then
+        echo "$f: ok"
+    else
+        echo "$f: FAILED"; status=1
+    fi
+    rm -f "$f-f.pfb" "$f.pfb"
+done
+exit $status
@@ -0,0 +1,180 @@
+/* t1kernels
+ *
+ * This program checks the byte kernel version named by T1UTILS_KERNELS
+ * against straightforward implementations of charstring encryption,
+ * decryption and hexadecimal encoding. It exits with status 77, which
+ * means "skipped" to `make check', if that version isn't available.
+ *
+ * Copyright (c) 1998-2017 Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, subject to the
+ * conditions listed in the Click LICENSE file, which is available in full at
+ * http://github.com/kohler/click/blob/master/LICENSE. The conditions
+ * include: you must preserve this copyright notice, and you cannot mention
+ * the copyright holders in advertising related to the Software without
+ * their permission. The Software is provided WITHOUT ANY WARRANTY, EXPRESS
+ * OR IMPLIED. This notice is a summary of the Click LICENSE file; the
+ * license in that file is binding.
+ */
+
+/* Note: this is ANSI C. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "t1lib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAXLEN		300
+#define MAXCS		40
+#define NTRIALS		300
+#define MAXREPORTS	10
+
+static const char *program_name = "t1kernels";
+static unsigned long seed = 1;
+static int nfailed = 0;
+
+void
+fatal_error(const char *message, ...)
+{
+  va_list val;
+  va_start(val, message);
+  fprintf(stderr, "%s: ", program_name);
+  vfprintf(stderr, message, val);
+  putc('\n', stderr);
+  va_end(val);
+  exit(1);
+}
+
+void
+error(const char *message, ...)
+{
+  va_list val;
+  va_start(val, message);
+  fprintf(stderr, "%s: ", program_name);
+  vfprintf(stderr, message, val);
+  putc('\n', stderr);
+  va_end(val);
+}
+
+static int
+random_int(int n)
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (int) ((seed >> 16) & 0x7FFF) % n;
+}
+
+/* lengths around the edges of lanes and transposed blocks */
+static const int edge_lengths[] = {
+  0, 1, 2, 3, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 255
+};
+
+static int
+random_length(void)
+{
+  int nedges = sizeof(edge_lengths) / sizeof(edge_lengths[0]);
+  if (random_int(2))
+    return edge_lengths[random_int(nedges)];
+  else
+    return random_int(MAXLEN + 1);
+}
+
+static void
+reference_crypt(unsigned char *cs, int len, int encrypt)
+{
+  unsigned r = CHARSTRING_KEY;
+  int i;
+  for (i = 0; i < len; i++) {
+    unsigned c = (encrypt ? (cs[i] ^ (r >> 8)) & 0xFF : cs[i]);
+    cs[i] = (unsigned char) (cs[i] ^ (r >> 8));
+    r = ((c + r) * 52845 + 22719) & 0xFFFF;
+  }
+}
+
+static void
+check_charstrings(int trial)
+{
+  unsigned char plain[MAXCS][MAXLEN], expect[MAXCS][MAXLEN], *cs[MAXCS];
+  int len[MAXCS], n = 1 + random_int(MAXCS), i, k;
+
+  for (k = 0; k < n; k++) {
+    len[k] = random_length();
+    for (i = 0; i < len[k]; i++)
+      plain[k][i] = (unsigned char) random_int(256);
+    memcpy(expect[k], plain[k], len[k]);
+    reference_crypt(expect[k], len[k], 1);
+    if (!(cs[k] = (unsigned char *) malloc(len[k] + 1)))
+      fatal_error("out of memory");
+    memcpy(cs[k], plain[k], len[k]);
+  }
+
+  encrypt_charstrings(cs, len, n);
+  for (k = 0; k < n; k++)
+    if (memcmp(cs[k], expect[k], len[k]) != 0) {
+      if (++nfailed <= MAXREPORTS)
+        error("trial %d: charstring %d of %d (length %d) encrypted wrong",
+              trial, k, n, len[k]);
+      memcpy(cs[k], expect[k], len[k]);
+    }
+
+  decrypt_charstrings(cs, len, n);
+  for (k = 0; k < n; k++) {
+    if (memcmp(cs[k], plain[k], len[k]) != 0 && ++nfailed <= MAXREPORTS)
+      error("trial %d: charstring %d of %d (length %d) decrypted wrong",
+            trial, k, n, len[k]);
+    free(cs[k]);
+  }
+}
+
+static void
+check_hex(int len, int offset)
+{
+  unsigned char src[MAXLEN + 4];
+  char dst[2 * MAXLEN + 8], expect[2 * MAXLEN + 8];
+  int i;
+
+  for (i = 0; i < len + offset; i++)
+    src[i] = (unsigned char) random_int(256);
+  for (i = 0; i < len; i++)
+    sprintf(expect + 2 * i, "%02x", src[offset + i]);
+  memset(dst, '*', sizeof(dst));
+  hex_encode(dst, src + offset, len);
+  if ((memcmp(dst, expect, 2 * len) != 0 || dst[2 * len] != '*')
+      && ++nfailed <= MAXREPORTS)
+    error("hex_encode of %d bytes at offset %d wrong", len, offset);
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *want = getenv("T1UTILS_KERNELS");
+  int i, offset;
+  (void) argc, (void) argv;
+
+  if (want && *want && strcmp(want, kernel_variant()) != 0)
+    return 77;
+
+  for (i = 0; i < NTRIALS; i++)
+    check_charstrings(i);
+  for (i = 0; i <= MAXLEN; i++)
+    for (offset = 0; offset < 4; offset++)
+      check_hex(i, offset);
+
+  if (nfailed)
+    fprintf(stderr, "%s: %s: %d checks failed\n", program_name,
+            kernel_variant(), nfailed);
+  return nfailed ? 1 : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif